@@ -0,0 +1,993 @@
+#define SDL_MAIN_HANDLED
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <thread>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <random>
+
+#include "encoder.hpp"
+#include "batch_encoder.hpp"
+#include "static_encoder.hpp"
+#include "streaming_decoder.hpp"
+
+/*
+   Headless benchmark for the encoder and decoder. A smooth synthetic test image is generated unless an input
+   bitmap is provided, so no window (or image files) are required.
+
+   Usage (parameters may be provided in any order):
+   .\benchmark.exe
+       OPTIONAL: -i [PATH_TO_INPUT_BMP] (the input bitmap - defaults to a synthetic image)
+       OPTIONAL: -w [WIDTH] -h [HEIGHT] (the size of the synthetic image - defaults to 4096x4096)
+       OPTIONAL: -q [QUALITY] (the quality value to use for encoding - defaults to 80)
+       OPTIONAL: -t [MAX_THREADS] (the largest thread count to benchmark - defaults to the number of cores)
+       OPTIONAL: -r [RESTART_INTERVAL] (the strip height in block-rows for threaded encoding - defaults to 4)
+*/
+
+jpeg::BitmapImageRGB createSyntheticImage(uint16_t width, uint16_t height){
+    jpeg::BitmapImageRGB image(width, height);
+    for (size_t y = 0 ; y < height ; ++y){
+        for (size_t x = 0 ; x < width ; ++x){
+            auto& pixel = image.m_imageData[y * width + x];
+            pixel.r = uint8_t(127.5 + 127.5 * std::sin(0.013 * x + 0.002 * y));
+            pixel.g = uint8_t(127.5 + 127.5 * std::cos(0.007 * x * std::sin(0.003 * y)));
+            pixel.b = uint8_t((x ^ y) & 0xFF);
+        }
+    }
+    return image;
+}
+
+/* Returns the fastest of several runs, in milliseconds */
+double timeFastestRun(std::function<void()> const& function, size_t numRuns = 3){
+    double fastest = 0;
+    for (size_t run = 0 ; run < numRuns ; ++run){
+        auto tStart = std::chrono::high_resolution_clock::now();
+        function();
+        auto tEnd = std::chrono::high_resolution_clock::now();
+        double const duration = 1e-3 * std::chrono::duration_cast<std::chrono::microseconds>(tEnd - tStart).count();
+        if (run == 0 || duration < fastest){
+            fastest = duration;
+        }
+    }
+    return fastest;
+}
+
+bool streamsMatch(jpeg::JPEGImage& a, jpeg::JPEGImage& b){
+    return a.m_compressedImageData.getSize() == b.m_compressedImageData.getSize()
+        && std::memcmp(a.m_compressedImageData.getDataPtr(), b.m_compressedImageData.getDataPtr(), a.m_compressedImageData.getSize()) == 0;
+}
+
+bool bitmapsMatch(jpeg::BitmapImageRGB const& a, jpeg::BitmapImageRGB const& b){
+    return a.m_imageData.size() == b.m_imageData.size()
+        && std::memcmp(a.m_imageData.data(), b.m_imageData.data(), a.m_imageData.size() * sizeof(jpeg::BitmapImageRGB::PixelData)) == 0;
+}
+
+/* Powers of two, followed by maxThreads */
+std::vector<unsigned int> getThreadCounts(unsigned int maxThreads){
+    std::vector<unsigned int> threadCounts;
+    for (unsigned int numThreads = 1 ; numThreads < maxThreads ; numThreads *= 2){
+        threadCounts.push_back(numThreads);
+    }
+    threadCounts.push_back(maxThreads);
+    return threadCounts;
+}
+
+/* Reports throughput of strip-parallel encoding from one thread up to maxThreads */
+void benchmarkThreadedEncoding(jpeg::BitmapImageRGB const& image, int quality, unsigned int maxThreads, uint16_t restartInterval){
+    double const megapixels = 1e-6 * image.m_width * image.height;
+    jpeg::BaselineEncoder encoder(quality);
+    jpeg::JPEGImage reference;
+    encoder.encode(image, reference, {.m_restartIntervalBlockRows = restartInterval, .m_numThreads = 1});
+
+    std::cout << "Strip-parallel encoding (" << restartInterval << " block-rows per restart interval)\n";
+    double singleThreadedTime = 0;
+    for (auto const numThreads : getThreadCounts(maxThreads)){
+        jpeg::JPEGImage output;
+        double const time = timeFastestRun([&]{
+            encoder.encode(image, output, {.m_restartIntervalBlockRows = restartInterval, .m_numThreads = numThreads});
+        });
+        if (numThreads == 1){
+            singleThreadedTime = time;
+        }
+        std::cout << "  " << numThreads << " thread(s): " << time << " ms | " << megapixels / (1e-3 * time) << " MPix/s | speedup: "
+                  << singleThreadedTime / time << "x | output " << (streamsMatch(reference, output) ? "identical" : "DIFFERS") << "\n";
+    }
+}
+
+/* Reports throughput of decoding restart intervals in parallel from one thread up to maxThreads */
+void benchmarkThreadedDecoding(jpeg::BitmapImageRGB const& image, int quality, unsigned int maxThreads, uint16_t restartInterval){
+    double const megapixels = 1e-6 * image.m_width * image.height;
+    jpeg::BaselineEncoder encoder(quality);
+    jpeg::JPEGImage encodedImage;
+    encoder.encode(image, encodedImage, {.m_restartIntervalBlockRows = restartInterval, .m_numThreads = maxThreads});
+    jpeg::BitmapImageRGB reference;
+    encoder.decode(encodedImage, reference);
+
+    std::cout << "Parallel decoding of restart intervals\n";
+    double singleThreadedTime = 0;
+    for (auto const numThreads : getThreadCounts(maxThreads)){
+        jpeg::BitmapImageRGB output;
+        double const time = timeFastestRun([&]{
+            encoder.decode(encodedImage, output, {.m_numThreads = numThreads});
+        });
+        if (numThreads == 1){
+            singleThreadedTime = time;
+        }
+        std::cout << "  " << numThreads << " thread(s): " << time << " ms | " << megapixels / (1e-3 * time) << " MPix/s | speedup: "
+                  << singleThreadedTime / time << "x | output " << (bitmapsMatch(reference, output) ? "identical" : "DIFFERS") << "\n";
+    }
+}
+
+/* Compares decoding at full size against decoding at each reduced scale */
+void benchmarkScaledDecoding(jpeg::BitmapImageRGB const& image, int quality){
+    double const megapixels = 1e-6 * image.m_width * image.height;
+    jpeg::BaselineEncoder encoder(quality);
+    jpeg::JPEGImage encodedImage;
+    encoder.encode(image, encodedImage);
+
+    std::cout << "Scaled decoding\n";
+    double fullSizeTime = 0;
+    for (uint8_t const scaleDenominator : {1, 2, 4, 8}){
+        jpeg::BitmapImageRGB output;
+        double const time = timeFastestRun([&]{
+            encoder.decode(encodedImage, output, {.m_scaleDenominator = scaleDenominator});
+        });
+        if (scaleDenominator == 1){
+            fullSizeTime = time;
+        }
+        std::cout << "  1/" << int(scaleDenominator) << " (" << output.m_width << "x" << output.height << "): " << time << " ms | " 
+                  << megapixels / (1e-3 * time) << " MPix/s (of input) | speedup: " << fullSizeTime / time << "x\n";
+    }
+}
+
+/* Peak signal-to-noise ratio (in dB) of a decoded image against the original */
+double computePsnr(jpeg::BitmapImageRGB const& original, jpeg::BitmapImageRGB const& decoded){
+    double squaredError = 0;
+    for (size_t i = 0 ; i < original.m_imageData.size() ; ++i){
+        for (auto const& [a, b] : {std::pair{original.m_imageData[i].r, decoded.m_imageData[i].r},
+                                  std::pair{original.m_imageData[i].g, decoded.m_imageData[i].g},
+                                  std::pair{original.m_imageData[i].b, decoded.m_imageData[i].b}}){
+            squaredError += (double(a) - b) * (double(a) - b);
+        }
+    }
+    double const meanSquaredError = std::max(squaredError / (3.0 * original.m_imageData.size()), 1e-9);
+    return 10 * std::log10(255.0 * 255.0 / meanSquaredError);
+}
+
+/* Compares the size, quality and speed of encoding with and without trellis quantisation. As trellis quantisation
+   trades quality for size, rounded encoding is also bisected for the lowest quality whose PSNR is at least that of
+   trellis quantisation, so that the sizes may be compared at equal PSNR. */
+void benchmarkTrellisQuantisation(jpeg::BitmapImageRGB const& image, int quality){
+    double const megapixels = 1e-6 * image.m_width * image.height;
+    jpeg::BaselineEncoder encoder(quality);
+
+    std::cout << "Trellis quantisation\n";
+    double trellisPsnr = 0;
+    size_t trellisFileSize = 0;
+    for (bool const trellisQuantisation : {false, true}){
+        jpeg::JPEGImage encodedImage;
+        double const time = timeFastestRun([&]{
+            encoder.encode(image, encodedImage, {.m_trellisQuantisation = trellisQuantisation});
+        });
+        jpeg::BitmapImageRGB decodedImage;
+        encoder.decode(encodedImage, decodedImage);
+        double const psnr = computePsnr(image, decodedImage);
+        std::cout << "  " << (trellisQuantisation ? "trellis" : "rounded") << ": " << time << " ms | " << megapixels / (1e-3 * time) << " MPix/s | "
+                  << encodedImage.m_fileSize << " bytes | PSNR " << psnr << " dB\n";
+        trellisPsnr = psnr;
+        trellisFileSize = encodedImage.m_fileSize;
+    }
+
+    int matchedQuality = 0;
+    size_t matchedFileSize = 0;
+    double matchedPsnr = 0;
+    int lowestQuality = 1, highestQuality = 100;
+    while (lowestQuality <= highestQuality){
+        int const candidateQuality = (lowestQuality + highestQuality) / 2;
+        jpeg::BaselineEncoder candidateEncoder(candidateQuality);
+        jpeg::JPEGImage encodedImage;
+        jpeg::BitmapImageRGB decodedImage;
+        candidateEncoder.encode(image, encodedImage);
+        candidateEncoder.decode(encodedImage, decodedImage);
+        double const psnr = computePsnr(image, decodedImage);
+        if (psnr >= trellisPsnr){
+            matchedQuality = candidateQuality;
+            matchedFileSize = encodedImage.m_fileSize;
+            matchedPsnr = psnr;
+            highestQuality = candidateQuality - 1;
+        }
+        else{
+            lowestQuality = candidateQuality + 1;
+        }
+    }
+    if (matchedQuality == 0){
+        std::cout << "  rounded at equal PSNR: no quality reaches " << trellisPsnr << " dB\n";
+        return;
+    }
+    std::cout << "  rounded at equal PSNR: quality " << matchedQuality << " | " << matchedFileSize << " bytes | PSNR " << matchedPsnr << " dB | trellis saves "
+              << 100.0 * (1.0 - double(trellisFileSize) / matchedFileSize) << "%\n";
+}
+
+/* Compares the size and speed of encoding with the typical Huffman tables and with tables optimised for the image,
+   checking that both decode to the same image */
+bool benchmarkOptimisedHuffmanTables(jpeg::BitmapImageRGB const& image, int quality){
+    double const megapixels = 1e-6 * image.m_width * image.height;
+    jpeg::BaselineEncoder encoder(quality);
+
+    std::cout << "Optimised Huffman tables\n";
+    std::array<jpeg::BitmapImageRGB, 2> decodedImages;
+    for (bool const optimiseHuffmanTables : {false, true}){
+        jpeg::JPEGImage encodedImage;
+        double const time = timeFastestRun([&]{
+            encoder.encode(image, encodedImage, {.m_optimiseHuffmanTables = optimiseHuffmanTables});
+        });
+        encoder.decode(encodedImage, decodedImages[optimiseHuffmanTables]);
+        std::cout << "  " << (optimiseHuffmanTables ? "optimised" : "typical") << ": " << time << " ms | " << megapixels / (1e-3 * time) << " MPix/s | "
+                  << encodedImage.m_fileSize << " bytes\n";
+    }
+    bool const match = bitmapsMatch(decodedImages[0], decodedImages[1]);
+    std::cout << "  decoded images " << (match ? "match" : "DIFFER") << "\n";
+    return match;
+}
+
+/* Compares the size and the encoding and decoding speed of Huffman coding (with typical and optimised tables) and
+   arithmetic coding, checking that all decode to the same image */
+bool benchmarkArithmeticCoding(jpeg::BitmapImageRGB const& image, int quality){
+    double const megapixels = 1e-6 * image.m_width * image.height;
+    jpeg::BaselineEncoder encoder(quality);
+    std::array<std::pair<char const*, jpeg::EncodeOptions>, 3> const codings{{
+        {"Huffman (typical)", {}},
+        {"Huffman (optimised)", {.m_optimiseHuffmanTables = true}},
+        {"arithmetic", {.m_arithmeticCoding = true}}
+    }};
+
+    std::cout << "Arithmetic coding\n";
+    std::array<jpeg::BitmapImageRGB, 3> decodedImages;
+    for (size_t coding = 0 ; coding < codings.size() ; ++coding){
+        jpeg::JPEGImage encodedImage;
+        double const encodeTime = timeFastestRun([&]{
+            encoder.encode(image, encodedImage, codings[coding].second);
+        });
+        double const decodeTime = timeFastestRun([&]{
+            encoder.decode(encodedImage, decodedImages[coding]);
+        });
+        std::cout << "  " << codings[coding].first << ": " << encodedImage.m_fileSize << " bytes | encode " << encodeTime << " ms ("
+                  << megapixels / (1e-3 * encodeTime) << " MPix/s) | decode " << decodeTime << " ms (" << megapixels / (1e-3 * decodeTime) << " MPix/s)\n";
+    }
+    bool const match = bitmapsMatch(decodedImages[0], decodedImages[2]) && bitmapsMatch(decodedImages[1], decodedImages[2]);
+    std::cout << "  decoded images " << (match ? "match" : "DIFFER") << "\n";
+    return match;
+}
+
+/* Returns the number of bytes of a JPEG up to the end of its first scan, by skipping the segments before the first
+   SOS segment, then its entropy-coded data (which restart markers end the scan early, so are not used with this) */
+size_t getFirstScanSize(jpeg::JPEGImage const& image){
+    auto const bytes = image.m_compressedImageData.getBytes();
+    size_t position = 2; // Skip SOI
+    while (position + 4 <= bytes.size()){
+        uint16_t const marker = uint16_t(bytes[position] << 8) | bytes[position + 1];
+        position += 2 + (size_t(bytes[position + 2]) << 8 | bytes[position + 3]);
+        if (marker == jpeg::markerStartOfScanSegmentSOS){
+            return image.m_compressedImageData.findNextMarker(position);
+        }
+    }
+    return bytes.size();
+}
+
+/* Compares the size and encoding speed of sequential encoding with optimised Huffman tables and progressive encoding,
+   and reports how much of the progressive image must be received before its first scan can be shown as a preview */
+void benchmarkProgressiveEncoding(jpeg::BitmapImageRGB const& image, int quality){
+    double const megapixels = 1e-6 * image.m_width * image.height;
+    jpeg::BaselineEncoder encoder(quality);
+
+    std::cout << "Progressive encoding\n";
+    for (bool const progressive : {false, true}){
+        jpeg::JPEGImage encodedImage;
+        double const time = timeFastestRun([&]{
+            encoder.encode(image, encodedImage, {.m_optimiseHuffmanTables = true, .m_progressive = progressive});
+        });
+        std::cout << "  " << (progressive ? "progressive" : "sequential (optimised)") << ": " << time << " ms | " << megapixels / (1e-3 * time) << " MPix/s | "
+                  << encodedImage.m_fileSize << " bytes | first scan " << getFirstScanSize(encodedImage) << " bytes\n";
+    }
+}
+
+/* Compares bisecting over quality with a new encoder per step against encoding to a target size, which transforms
+   the image only once. The target is the size of the image encoded at the given quality. */
+void benchmarkTargetSizeEncoding(jpeg::BitmapImageRGB const& image, int quality){
+    jpeg::JPEGImage reference;
+    jpeg::BaselineEncoder(quality).encode(image, reference);
+    size_t const targetFileSize = reference.m_fileSize;
+
+    std::cout << "Encoding to a target size (" << targetFileSize << " bytes)\n";
+    int bisectedQuality = 0;
+    jpeg::JPEGImage bisectedImage;
+    double const bisectionTime = timeFastestRun([&]{
+        int lowestQuality = 1, highestQuality = 100;
+        while (lowestQuality <= highestQuality){
+            int const candidateQuality = (lowestQuality + highestQuality) / 2;
+            jpeg::JPEGImage candidateImage;
+            jpeg::BaselineEncoder(candidateQuality).encode(image, candidateImage);
+            if (candidateImage.m_fileSize <= targetFileSize){
+                bisectedQuality = candidateQuality;
+                bisectedImage = std::move(candidateImage);
+                lowestQuality = candidateQuality + 1;
+            }
+            else{
+                highestQuality = candidateQuality - 1;
+            }
+        }
+    });
+    std::cout << "  bisection with new encoders: " << bisectionTime << " ms | quality " << bisectedQuality << "\n";
+
+    int targetQuality = 0;
+    jpeg::JPEGImage targetImage;
+    jpeg::BaselineEncoder encoder(quality);
+    double const targetTime = timeFastestRun([&]{
+        targetQuality = encoder.encodeToSize(image, targetImage, targetFileSize);
+    });
+    bool const outputMatches = targetQuality == bisectedQuality && streamsMatch(targetImage, bisectedImage);
+    std::cout << "  encodeToSize: " << targetTime << " ms | quality " << targetQuality << " | speedup: " << bisectionTime / targetTime << "x | "
+              << (outputMatches ? "output identical" : "OUTPUT DIFFERS") << "\n";
+}
+
+/* Compares encoding many small images with a new encoder per image against the batch encoder */
+void benchmarkBatchEncoding(unsigned int maxThreads){
+    size_t const batchSize = 256;
+    uint16_t const imageSize = 128;
+    std::vector<jpeg::BitmapImageRGB> images;
+    std::vector<int> qualities;
+    for (size_t i = 0 ; i < batchSize ; ++i){
+        images.push_back(createSyntheticImage(imageSize + i % 8, imageSize));
+        qualities.push_back(50 + i % 4 * 10);
+    }
+
+    std::cout << "Batch encoding (" << batchSize << " images of " << imageSize << "x" << imageSize << ")\n";
+    std::vector<jpeg::JPEGImage> reference(batchSize);
+    double const serialTime = timeFastestRun([&]{
+        for (size_t i = 0 ; i < batchSize ; ++i){
+            jpeg::BaselineEncoder encoder(qualities[i]);
+            encoder.encode(images[i], reference[i]);
+        }
+    });
+    std::cout << "  new encoder per image: " << serialTime << " ms | " << batchSize / (1e-3 * serialTime) << " images/s\n";
+    for (auto const numThreads : getThreadCounts(maxThreads)){
+        jpeg::BatchEncoder batchEncoder(numThreads);
+        std::vector<jpeg::JPEGImage> output;
+        double const time = timeFastestRun([&]{
+            output = batchEncoder.encode(images, qualities);
+        });
+        bool allMatch = true;
+        for (size_t i = 0 ; i < batchSize ; ++i){
+            allMatch &= streamsMatch(reference[i], output[i]);
+        }
+        std::cout << "  batch encoder, " << numThreads << " thread(s): " << time << " ms | " << batchSize / (1e-3 * time) << " images/s | speedup: "
+                  << serialTime / time << "x | output " << (allMatch ? "identical" : "DIFFERS") << "\n";
+    }
+}
+
+/* Compares the dependency-injected encoder against the compile-time specialised encoder with the same components */
+void benchmarkStaticEncoding(jpeg::BitmapImageRGB const& image, int quality){
+    double const megapixels = 1e-6 * image.m_width * image.height;
+    jpeg::BaselineEncoder encoder(quality);
+    jpeg::StaticBaselineEncoder staticEncoder(quality);
+    jpeg::JPEGImage reference, output;
+
+    std::cout << "Static dispatch\n";
+    double const dynamicTime = timeFastestRun([&]{
+        encoder.encode(image, reference);
+    });
+    std::cout << "  Encoder: " << dynamicTime << " ms | " << megapixels / (1e-3 * dynamicTime) << " MPix/s\n";
+    double const staticTime = timeFastestRun([&]{
+        staticEncoder.encode(image, output);
+    });
+    std::cout << "  StaticEncoder: " << staticTime << " ms | " << megapixels / (1e-3 * staticTime) << " MPix/s | speedup: "
+              << dynamicTime / staticTime << "x | output " << (streamsMatch(reference, output) ? "identical" : "DIFFERS") << "\n";
+}
+
+/* Compares copying an externally owned (padded BGRA) frame into a bitmap before encoding against encoding a view of it */
+void benchmarkImageViewEncoding(jpeg::BitmapImageRGB const& image, int quality){
+    double const megapixels = 1e-6 * image.m_width * image.height;
+    size_t const stride = 4 * size_t(image.m_width) + 64;
+    std::vector<uint8_t> frame(stride * image.height);
+    for (size_t y = 0 ; y < image.height ; ++y){
+        for (size_t x = 0 ; x < image.m_width ; ++x){
+            auto const& pixel = image.m_imageData[y * image.m_width + x];
+            uint8_t* const dest = frame.data() + y * stride + 4 * x;
+            dest[0] = pixel.b; dest[1] = pixel.g; dest[2] = pixel.r; dest[3] = 0xFF;
+        }
+    }
+    jpeg::BaselineEncoder encoder(quality);
+    jpeg::JPEGImage reference, output;
+
+    std::cout << "Encoding an external BGRA frame\n";
+    double const copyTime = timeFastestRun([&]{
+        jpeg::BitmapImageRGB copy(image.m_width, image.height);
+        for (size_t y = 0 ; y < image.height ; ++y){
+            for (size_t x = 0 ; x < image.m_width ; ++x){
+                uint8_t const* const src = frame.data() + y * stride + 4 * x;
+                copy.m_imageData[y * image.m_width + x] = {src[2], src[1], src[0]};
+            }
+        }
+        encoder.encode(copy, reference);
+    });
+    std::cout << "  copy into bitmap: " << copyTime << " ms | " << megapixels / (1e-3 * copyTime) << " MPix/s\n";
+    double const viewTime = timeFastestRun([&]{
+        encoder.encode(jpeg::ImageView(frame.data(), image.m_width, image.height, stride, jpeg::PixelFormat::BGRA32), output);
+    });
+    std::cout << "  image view: " << viewTime << " ms | " << megapixels / (1e-3 * viewTime) << " MPix/s | speedup: "
+              << copyTime / viewTime << "x | output " << (streamsMatch(reference, output) ? "identical" : "DIFFERS") << "\n";
+}
+
+/* Compares encoding into a JPEGImage against encoding straight into a reused, caller-supplied buffer */
+void benchmarkBufferSinkEncoding(jpeg::BitmapImageRGB const& image, int quality){
+    double const megapixels = 1e-6 * image.m_width * image.height;
+    jpeg::BaselineEncoder encoder(quality);
+    jpeg::JPEGImage reference;
+    std::vector<uint8_t> buffer(3 * size_t(image.m_width) * image.height + 1024);
+    std::span<uint8_t const> output;
+
+    std::cout << "Encoding into a caller-supplied buffer\n";
+    double const imageTime = timeFastestRun([&]{
+        encoder.encode(image, reference);
+    });
+    std::cout << "  JPEGImage: " << imageTime << " ms | " << megapixels / (1e-3 * imageTime) << " MPix/s\n";
+    double const bufferTime = timeFastestRun([&]{
+        jpeg::BufferOutputSink sink(buffer);
+        encoder.encode(image, sink);
+        output = sink.getOutput();
+    });
+    bool const outputMatches = output.size() == reference.m_compressedImageData.getSize()
+                               && std::memcmp(output.data(), reference.m_compressedImageData.getDataPtr(), output.size()) == 0;
+    std::cout << "  BufferOutputSink: " << bufferTime << " ms | " << megapixels / (1e-3 * bufferTime) << " MPix/s | speedup: "
+              << imageTime / bufferTime << "x | output " << (outputMatches ? "identical" : "DIFFERS") << "\n";
+}
+
+/* Times the forward and inverse transform of each transformer on the same blocks, then whole-image encoding with each DCT method */
+void benchmarkTransforms(jpeg::BitmapImageRGB const& image, int quality){
+    size_t const numBlocks = 4096;
+    std::vector<jpeg::ColourMappedBlockData::BlockChannelData> blocks(numBlocks);
+    for (size_t block = 0 ; block < numBlocks ; ++block){
+        for (size_t i = 0 ; i < jpeg::BlockGrid::blockElements ; ++i){
+            blocks[block][i] = image.m_imageData[(block * jpeg::BlockGrid::blockElements + i) % image.m_imageData.size()].g;
+        }
+    }
+    std::vector<jpeg::DctBlockChannelData> coefficients(numBlocks);
+    std::vector<jpeg::ColourMappedBlockData::BlockChannelData> reconstructedBlocks(numBlocks);
+
+    std::cout << "DCT/IDCT (" << numBlocks << " blocks)\n";
+    auto benchmarkTransformer = [&](char const* name, jpeg::DiscreteCosineTransformer const& transformer){
+        double const forwardTime = timeFastestRun([&]{
+            for (size_t block = 0 ; block < numBlocks ; ++block){
+                coefficients[block] = transformer.transform(blocks[block]);
+            }
+        });
+        // Coefficients are in whatever scale the transformer leaves them, which its inverse expects after rescaling
+        auto const forwardScaleFactors = transformer.getForwardScaleFactors();
+        auto const inverseScaleFactors = transformer.getInverseScaleFactors();
+        for (auto& blockCoefficients : coefficients){
+            for (size_t i = 0 ; i < jpeg::BlockGrid::blockElements ; ++i){
+                blockCoefficients.m_data[i] *= inverseScaleFactors[i] / forwardScaleFactors[i];
+            }
+        }
+        double const inverseTime = timeFastestRun([&]{
+            for (size_t block = 0 ; block < numBlocks ; ++block){
+                reconstructedBlocks[block] = transformer.inverseTransform(coefficients[block]);
+            }
+        });
+        int maxError = 0;
+        for (size_t block = 0 ; block < numBlocks ; ++block){
+            for (size_t i = 0 ; i < jpeg::BlockGrid::blockElements ; ++i){
+                maxError = std::max(maxError, std::abs(int(blocks[block][i]) - int(reconstructedBlocks[block][i])));
+            }
+        }
+        std::cout << "  " << name << ": forward " << 1e3 * forwardTime / numBlocks << " us/block | inverse " 
+                  << 1e3 * inverseTime / numBlocks << " us/block | max round-trip error " << maxError << "\n";
+    };
+    benchmarkTransformer("Naive", jpeg::NaiveCosineTransformer());
+    benchmarkTransformer("Separated", jpeg::SeparatedDiscreteCosineTransformer());
+    for (auto const simdLevel : {jpeg::SimdLevel::Scalar, jpeg::SimdLevel::SSE2, jpeg::SimdLevel::AVX2}){
+        if (simdLevel <= jpeg::getSupportedSimdLevel()){
+            benchmarkTransformer((std::string("AAN (") + jpeg::getSimdLevelName(simdLevel) + ")").c_str(), jpeg::AANDiscreteCosineTransformer(simdLevel));
+        }
+    }
+    benchmarkTransformer("Integer", jpeg::IntegerDiscreteCosineTransformer());
+
+    std::cout << "Quantisation (" << numBlocks << " blocks)\n";
+    jpeg::SeparatedDiscreteCosineTransformer const separatedTransformer;
+    for (size_t block = 0 ; block < numBlocks ; ++block){
+        coefficients[block] = separatedTransformer.transform(blocks[block]);
+    }
+    std::vector<jpeg::QuantisedBlockChannelData> quantisedBlocks(numBlocks);
+    for (auto const simdLevel : {jpeg::SimdLevel::Scalar, jpeg::SimdLevel::SSE2, jpeg::SimdLevel::AVX2}){
+        if (simdLevel > jpeg::getSupportedSimdLevel()){
+            continue;
+        }
+        jpeg::Quantiser const quantiser(quality, simdLevel);
+        double const quantiseTime = timeFastestRun([&]{
+            for (size_t block = 0 ; block < numBlocks ; ++block){
+                quantisedBlocks[block] = quantiser.quantise(coefficients[block], block % 2);
+            }
+        });
+        double const dequantiseTime = timeFastestRun([&]{
+            for (size_t block = 0 ; block < numBlocks ; ++block){
+                coefficients[block] = quantiser.dequantise(quantisedBlocks[block], block % 2);
+            }
+        });
+        std::cout << "  " << jpeg::getSimdLevelName(simdLevel) << ": quantise " << 1e3 * quantiseTime / numBlocks << " us/block | dequantise "
+                  << 1e3 * dequantiseTime / numBlocks << " us/block\n";
+        for (size_t block = 0 ; block < numBlocks ; ++block){
+            coefficients[block] = separatedTransformer.transform(blocks[block]);
+        }
+    }
+
+    double const megapixels = 1e-6 * image.m_width * image.height;
+    for (auto const& [name, dctMethod] : {std::pair{"Separated", jpeg::DctMethod::Separated}, std::pair{"AAN", jpeg::DctMethod::AAN}, std::pair{"Integer", jpeg::DctMethod::Integer}}){
+        jpeg::BaselineEncoder encoder(quality, dctMethod);
+        jpeg::JPEGImage output;
+        double const time = timeFastestRun([&]{
+            encoder.encode(image, output);
+        });
+        std::cout << "  encoding with " << name << " DCT: " << time << " ms | " << megapixels / (1e-3 * time) << " MPix/s | " 
+                  << output.m_compressedImageData.getSize() << " bytes\n";
+    }
+}
+
+/* Checks that each SIMD kernel supported by this CPU gives the same results as the scalar transforms, on random blocks */
+bool checkSimdTransforms(){
+    size_t const numBlocks = 100000;
+    std::mt19937 generator(0);
+    std::uniform_int_distribution<int> sampleDistribution(0, 255);
+    std::uniform_int_distribution<int> coefficientDistribution(-1024, 1023);
+    jpeg::AANDiscreteCosineTransformer const scalarTransformer(jpeg::SimdLevel::Scalar);
+
+    std::cout << "SIMD DCT self-check (" << numBlocks << " random blocks, supported: " << jpeg::getSimdLevelName(jpeg::getSupportedSimdLevel())
+              << ", preferred: " << jpeg::getSimdLevelName(jpeg::getPreferredSimdLevel()) << ")\n";
+    bool allMatch = true;
+    for (auto const simdLevel : {jpeg::SimdLevel::SSE2, jpeg::SimdLevel::AVX2}){
+        if (simdLevel > jpeg::getSupportedSimdLevel()){
+            std::cout << "  " << jpeg::getSimdLevelName(simdLevel) << ": not supported\n";
+            continue;
+        }
+        jpeg::AANDiscreteCosineTransformer const simdTransformer(simdLevel);
+        size_t forwardMismatches = 0, inverseMismatches = 0;
+        for (size_t block = 0 ; block < numBlocks ; ++block){
+            jpeg::ColourMappedBlockData::BlockChannelData samples;
+            jpeg::DctBlockChannelData coefficients;
+            for (size_t i = 0 ; i < jpeg::BlockGrid::blockElements ; ++i){
+                samples[i] = sampleDistribution(generator);
+                coefficients.m_data[i] = coefficientDistribution(generator);
+            }
+            forwardMismatches += scalarTransformer.transform(samples).m_data != simdTransformer.transform(samples).m_data;
+            inverseMismatches += scalarTransformer.inverseTransform(coefficients) != simdTransformer.inverseTransform(coefficients);
+        }
+        std::cout << "  " << jpeg::getSimdLevelName(simdLevel) << ": " << forwardMismatches << " forward and " 
+                  << inverseMismatches << " inverse mismatches\n";
+        allMatch &= (forwardMismatches == 0 && inverseMismatches == 0);
+    }
+    return allMatch;
+}
+
+/* Checks that each SIMD quantiser supported by this CPU gives the same results as the scalar quantiser, for each
+   transformer's scale factors. Many random coefficients are placed on, or next to, the boundaries at which the
+   rounding of quotients changes (all divisors are 1 at quality 100, without scale factors). */
+bool checkSimdQuantisers(){
+    size_t const numBlocks = 20000;
+    std::mt19937 generator(0);
+    std::uniform_real_distribution<float> coefficientDistribution(-16384, 16384);
+    std::uniform_int_distribution<int> integerDistribution(-16384, 16384);
+    std::uniform_int_distribution<int> quantisedDistribution(-2048, 2047);
+    std::uniform_int_distribution<int> caseDistribution(0, 3);
+
+    std::cout << "SIMD quantiser self-check (" << numBlocks << " random blocks per transformer and quality)\n";
+    bool allMatch = true;
+    for (auto const simdLevel : {jpeg::SimdLevel::SSE2, jpeg::SimdLevel::AVX2}){
+        if (simdLevel > jpeg::getSupportedSimdLevel()){
+            std::cout << "  " << jpeg::getSimdLevelName(simdLevel) << ": not supported\n";
+            continue;
+        }
+        size_t quantiseMismatches = 0, dequantiseMismatches = 0;
+        for (auto const dctMethod : {jpeg::DctMethod::Separated, jpeg::DctMethod::AAN, jpeg::DctMethod::Integer}){
+            std::unique_ptr<jpeg::DiscreteCosineTransformer> const transformer = jpeg::createDiscreteCosineTransformer(dctMethod);
+            for (int const quality : {10, 50, 90, 100}){
+                jpeg::Quantiser scalarQuantiser(quality, jpeg::SimdLevel::Scalar), simdQuantiser(quality, simdLevel);
+                scalarQuantiser.applyTransformScaling(*transformer);
+                simdQuantiser.applyTransformScaling(*transformer);
+                for (size_t block = 0 ; block < numBlocks ; ++block){
+                    jpeg::DctBlockChannelData coefficients;
+                    jpeg::QuantisedBlockChannelData quantised;
+                    for (size_t i = 0 ; i < jpeg::BlockGrid::blockElements ; ++i){
+                        float const halfInteger = integerDistribution(generator) / 8 + 0.5f;
+                        switch (transformer->hasIntegerCoefficients() ? 0 : caseDistribution(generator)){
+                            case 0:
+                                coefficients.m_data[i] = integerDistribution(generator);
+                                break;
+                            case 1:
+                                coefficients.m_data[i] = coefficientDistribution(generator);
+                                break;
+                            default:
+                                coefficients.m_data[i] = std::nextafter(halfInteger, (caseDistribution(generator) < 2) ? -INFINITY : INFINITY);
+                                break;
+                        }
+                        quantised.m_data[i] = quantisedDistribution(generator);
+                    }
+                    bool const isLuminance = block % 2;
+                    quantiseMismatches += scalarQuantiser.quantise(coefficients, isLuminance).m_data != simdQuantiser.quantise(coefficients, isLuminance).m_data;
+                    dequantiseMismatches += scalarQuantiser.dequantise(quantised, isLuminance).m_data != simdQuantiser.dequantise(quantised, isLuminance).m_data;
+                }
+            }
+        }
+        std::cout << "  " << jpeg::getSimdLevelName(simdLevel) << ": " << quantiseMismatches << " quantise and " 
+                  << dequantiseMismatches << " dequantise mismatches\n";
+        allMatch &= (quantiseMismatches == 0 && dequantiseMismatches == 0);
+    }
+    return allMatch;
+}
+
+/* Checks that the sparse inverse transforms give the same results as the full transform, on random blocks whose
+   non-zero coefficients lie in the top-left 1x1, 2x2 and 4x4 corners */
+bool checkSparseInverseTransforms(){
+    size_t const numBlocks = 100000;
+    std::mt19937 generator(0);
+    std::uniform_int_distribution<int> coefficientDistribution(-1024, 1023);
+    jpeg::SeparatedDiscreteCosineTransformer const transformer;
+
+    std::cout << "Sparse IDCT self-check (" << numBlocks << " random blocks per extent)\n";
+    bool allMatch = true;
+    for (uint8_t const extent : {1, 2, 4}){
+        size_t mismatches = 0;
+        for (size_t block = 0 ; block < numBlocks ; ++block){
+            jpeg::DctBlockChannelData coefficients;
+            coefficients.m_data.fill(0);
+            for (size_t v = 0 ; v < extent ; ++v){
+                for (size_t u = 0 ; u < extent ; ++u){
+                    coefficients.m_data[u + v * jpeg::BlockGrid::blockSize] = coefficientDistribution(generator);
+                }
+            }
+            jpeg::DctBlockChannelData sparseCoefficients = coefficients;
+            sparseCoefficients.m_nonZeroExtent = extent;
+            mismatches += transformer.inverseTransform(coefficients) != transformer.inverseTransform(sparseCoefficients);
+        }
+        std::cout << "  " << int(extent) << "x" << int(extent) << ": " << mismatches << " mismatches\n";
+        allMatch &= (mismatches == 0);
+    }
+    return allMatch;
+}
+
+/* Checks that a single decoder, which reads the tables of each JPEG, decodes images of every quality exactly as the
+   encoder that produced them does */
+bool checkSharedDecoder(jpeg::BitmapImageRGB const& image){
+    jpeg::BaselineEncoder sharedDecoder(50);
+    std::cout << "Shared decoder self-check (qualities 1 to 100)\n";
+    size_t mismatches = 0;
+    for (int quality = 1 ; quality <= 100 ; ++quality){
+        jpeg::BaselineEncoder encoder(quality);
+        jpeg::JPEGImage encodedImage;
+        encoder.encode(image, encodedImage);
+        jpeg::BitmapImageRGB ownDecode, sharedDecode;
+        encoder.decode(encodedImage, ownDecode);
+        sharedDecoder.decode(encodedImage, sharedDecode);
+        mismatches += !bitmapsMatch(ownDecode, sharedDecode);
+    }
+    std::cout << "  " << mismatches << " mismatches\n";
+    return mismatches == 0;
+}
+
+/* Returns a copy of a JPEG with 0xFF fill bytes before each marker in its entropy-coded data (the RST markers and the
+   EOI marker), varying from one to three fill bytes per marker */
+jpeg::JPEGImage addFillBytes(jpeg::JPEGImage const& image){
+    auto const bytes = image.m_compressedImageData.getBytes();
+    size_t startOfScanData = 2; // Skip SOI
+    while (startOfScanData + 4 <= bytes.size()){
+        uint16_t const marker = uint16_t(bytes[startOfScanData] << 8) | bytes[startOfScanData + 1];
+        startOfScanData += 2 + (size_t(bytes[startOfScanData + 2]) << 8 | bytes[startOfScanData + 3]);
+        if (marker == jpeg::markerStartOfScanSegmentSOS){
+            break;
+        }
+    }
+    jpeg::JPEGImage filledImage;
+    size_t numMarkers = 0;
+    for (size_t position = 0 ; position < bytes.size() ; ++position){
+        if (position >= startOfScanData && bytes[position] == 0xFF && position + 1 < bytes.size() && bytes[position + 1] != 0x00){
+            for (size_t fillByte = 0 ; fillByte <= numMarkers % 3 ; ++fillByte){
+                filledImage.m_compressedImageData.pushByte(0xFF);
+            }
+            ++numMarkers;
+        }
+        filledImage.m_compressedImageData.pushByte(bytes[position]);
+    }
+    filledImage.m_width = image.m_width;
+    filledImage.m_height = image.m_height;
+    filledImage.m_fileSize = filledImage.m_compressedImageData.getSize();
+    return filledImage;
+}
+
+/* Checks that JPEGs with fill bytes before their RST and EOI markers, which Section B.1.1.2 of ITU-T81 allows, decode
+   exactly as they do without them, with and without arithmetic coding, and on one thread or several. Huffman-coded
+   JPEGs are also decoded by a StreamingDecoder, whose bands are gathered into a bitmap. */
+bool checkFillBytes(jpeg::BitmapImageRGB const& image){
+    jpeg::BaselineEncoder encoder(80);
+    std::cout << "Fill byte self-check (before each RST and EOI marker)\n";
+    size_t mismatches = 0;
+    for (bool const arithmeticCoding : {false, true}){
+        jpeg::JPEGImage encodedImage;
+        encoder.encode(image, encodedImage, {.m_restartIntervalBlockRows = 1, .m_arithmeticCoding = arithmeticCoding});
+        jpeg::JPEGImage const filledImage = addFillBytes(encodedImage);
+        for (unsigned int const numThreads : {1u, 4u}){
+            jpeg::BitmapImageRGB reference, output;
+            encoder.decode(encodedImage, reference, {.m_numThreads = numThreads});
+            encoder.decode(filledImage, output, {.m_numThreads = numThreads});
+            mismatches += reference.m_imageData.empty() || !bitmapsMatch(reference, output);
+        }
+        if (!arithmeticCoding){
+            jpeg::BitmapImageRGB reference, streamedOutput(image.m_width, image.height);
+            encoder.decode(encodedImage, reference);
+            jpeg::StreamingDecoder streamingDecoder(encoder, [&](uint16_t firstRow, jpeg::BitmapImageRGB const& band){
+                std::copy(band.m_imageData.begin(), band.m_imageData.end(), streamedOutput.m_imageData.begin() + size_t(firstRow) * image.m_width);
+            });
+            streamingDecoder.decode(filledImage);
+            mismatches += reference.m_imageData.empty() || !bitmapsMatch(reference, streamedOutput);
+        }
+    }
+    std::cout << "  " << mismatches << " mismatches\n";
+    return mismatches == 0;
+}
+
+/* Reads the next numBits bits of entropy-coded data as an unsigned value */
+uint32_t readBits(jpeg::BitReader& reader, size_t numBits){
+    if (numBits == 0){
+        return 0;
+    }
+    uint32_t const bits = reader.peekBits(numBits);
+    reader.skipBits(numBits);
+    return bits;
+}
+
+/* Reads the next Huffman symbol one bit at a time, by comparison with the first code of each length, as in Figure
+   F.16 of ITU-T81 (returning 0 if no code matches) */
+uint8_t readHuffmanSymbol(jpeg::BitReader& reader, jpeg::HuffmanTableSpecification const& specification){
+    int code = 0, firstCode = 0;
+    size_t firstIndex = 0;
+    for (uint8_t const count : specification.m_codeLengthCounts){
+        code = (code << 1) | int(readBits(reader, 1));
+        if (code - firstCode < count){
+            return specification.m_values[firstIndex + code - firstCode];
+        }
+        firstIndex += count;
+        firstCode = (firstCode + count) << 1;
+    }
+    return 0;
+}
+
+/* Recovers a signed value from its category and additional bits (EXTEND in Figure F.12 of ITU-T81) */
+int extendValue(uint32_t bits, size_t category){
+    return (category > 0 && bits < (1u << (category - 1))) ? int(bits) - (1 << category) + 1 : int(bits);
+}
+
+/* Decodes a scan of a progressive JPEG with the procedures of Section G.2 of ITU-T81 (following libjpeg for AC
+   refinement), adding the bits that it codes to the coefficients of the blocks */
+void decodeProgressiveScan(jpeg::BitReader& reader, jpeg::ScanParameters const& scan, std::array<std::optional<jpeg::HuffmanTableSpecification>, 8> const& specifications,
+                           std::vector<std::array<jpeg::QuantisedBlockChannelData, 3>>& blocks){
+    std::array<int, 3> lastDCValues = {0,0,0};
+    size_t endOfBandRun = 0;
+    int const positiveBit = 1 << scan.m_approximationLow, negativeBit = -positiveBit;
+    for (auto& block : blocks){
+        for (size_t component = 0 ; component < 3 ; ++component){
+            if (!scan.includesComponent(component)){
+                continue;
+            }
+            auto& coefficients = block[component].m_data;
+            jpeg::HuffmanTableSpecification const& specification = specifications[(scan.m_spectralStart == 0 ? 0 : 4) + (component != 0)].value_or(jpeg::HuffmanTableSpecification{});
+            if (scan.m_spectralStart == 0 && scan.m_approximationHigh == 0){
+                size_t const category = readHuffmanSymbol(reader, specification);
+                lastDCValues[component] += extendValue(readBits(reader, category), category);
+                coefficients[0] = int16_t(lastDCValues[component] * positiveBit);
+            }
+            else if (scan.m_spectralStart == 0){
+                coefficients[0] |= int16_t(readBits(reader, 1) << scan.m_approximationLow);
+            }
+            else if (scan.m_approximationHigh == 0){
+                if (endOfBandRun > 0){
+                    --endOfBandRun;
+                    continue;
+                }
+                for (size_t index = scan.m_spectralStart ; index <= scan.m_spectralEnd ; ++index){
+                    uint8_t const symbol = readHuffmanSymbol(reader, specification);
+                    size_t const runLength = symbol >> 4, category = symbol & 0xF;
+                    if (category == 0 && runLength < 15){
+                        endOfBandRun = (size_t(1) << runLength) + readBits(reader, runLength) - 1;
+                        break;
+                    }
+                    index += (category == 0) ? 15 : runLength;
+                    if (category != 0 && index <= scan.m_spectralEnd){
+                        coefficients[jpeg::zigZagIndices[index]] = int16_t(extendValue(readBits(reader, category), category) * positiveBit);
+                    }
+                }
+            }
+            else{
+                // The next bit of each coefficient that is already non-zero is a correction bit
+                auto refine = [&](int16_t& coefficient){
+                    if (readBits(reader, 1) && (coefficient & positiveBit) == 0){
+                        coefficient += int16_t(coefficient >= 0 ? positiveBit : negativeBit);
+                    }
+                };
+                size_t index = scan.m_spectralStart;
+                if (endOfBandRun == 0){
+                    for ( ; index <= scan.m_spectralEnd ; ++index){
+                        uint8_t const symbol = readHuffmanSymbol(reader, specification);
+                        size_t runLength = symbol >> 4;
+                        int newValue = 0;
+                        if ((symbol & 0xF) != 0){
+                            newValue = readBits(reader, 1) ? positiveBit : negativeBit;
+                        }
+                        else if (runLength < 15){
+                            endOfBandRun = (size_t(1) << runLength) + readBits(reader, runLength);
+                            break;
+                        }
+                        // Skip the run of coefficients which are still zero, refining those which are not on the way
+                        for ( ; index <= scan.m_spectralEnd ; ++index){
+                            int16_t& coefficient = coefficients[jpeg::zigZagIndices[index]];
+                            if (coefficient != 0){
+                                refine(coefficient);
+                            }
+                            else if (runLength-- == 0){
+                                break;
+                            }
+                        }
+                        if (newValue != 0 && index <= scan.m_spectralEnd){
+                            coefficients[jpeg::zigZagIndices[index]] = int16_t(newValue);
+                        }
+                    }
+                }
+                if (endOfBandRun > 0){
+                    for ( ; index <= scan.m_spectralEnd ; ++index){
+                        if (coefficients[jpeg::zigZagIndices[index]] != 0){
+                            refine(coefficients[jpeg::zigZagIndices[index]]);
+                        }
+                    }
+                    --endOfBandRun;
+                }
+            }
+        }
+    }
+}
+
+/* Checks that the standard progressive scans code every bit of random quantised blocks, by decoding each scan with
+   the tables of its DHT segment and comparing the rebuilt blocks with the originals. The blocks range from dense to
+   sparse, with a stretch of empty blocks longer than the longest run that an EOBn symbol can code. */
+bool checkProgressiveScans(){
+    size_t const numBlocks = 50000;
+    std::mt19937 generator(0);
+    std::uniform_int_distribution<int> dcDistribution(-1024, 1023);
+    std::uniform_int_distribution<int> smallDistribution(1, 7);
+    std::uniform_int_distribution<int> largeDistribution(8, 1023);
+    std::uniform_int_distribution<int> caseDistribution(0, 99);
+    std::uniform_int_distribution<size_t> extentDistribution(0, jpeg::BlockGrid::blockElements - 1);
+    std::vector<std::array<jpeg::QuantisedBlockChannelData, 3>> blocks(numBlocks);
+    for (size_t block = 0 ; block < numBlocks ; ++block){
+        if (block >= 5000 && block < 45000){
+            continue;
+        }
+        for (auto& channel : blocks[block]){
+            int const density = std::array{5, 30, 80}[caseDistribution(generator) % 3];
+            size_t const extent = extentDistribution(generator);
+            channel.m_data[0] = int16_t(dcDistribution(generator));
+            for (size_t index = 1 ; index <= extent ; ++index){
+                int const sign = (caseDistribution(generator) % 2) ? 1 : -1;
+                int const magnitude = (caseDistribution(generator) >= density) ? 0 : (caseDistribution(generator) < 50) ? 1 : (caseDistribution(generator) < 80) ? smallDistribution(generator) : largeDistribution(generator);
+                channel.m_data[jpeg::zigZagIndices[index]] = int16_t(sign * magnitude);
+            }
+        }
+    }
+
+    std::cout << "Progressive scan self-check (" << numBlocks << " random blocks per component)\n";
+    std::vector<std::array<jpeg::QuantisedBlockChannelData, 3>> decodedBlocks(numBlocks);
+    size_t misreadScans = 0;
+    for (jpeg::ScanParameters const& scan : jpeg::ProgressiveHuffmanEncoder::standardScans){
+        jpeg::SymbolFrequencies frequencies;
+        jpeg::BitStream tables, scanData;
+        std::array<std::optional<jpeg::HuffmanTableSpecification>, 8> specifications;
+        {
+            jpeg::ProgressiveHuffmanEncoder::IntervalEncoder symbolCounter(scan, frequencies);
+            for (auto const& block : blocks){
+                for (size_t component = 0 ; component < 3 ; ++component){
+                    if (scan.includesComponent(component)){
+                        symbolCounter.encode(block[component], component, component == 0);
+                    }
+                }
+            }
+            symbolCounter.finish();
+        }
+        jpeg::ProgressiveHuffmanEncoder const progressiveEncoder(scan, frequencies);
+        progressiveEncoder.encodeHeaderEntropyTables(tables);
+        if (tables.getSize() > 0){
+            jpeg::BitStreamReadProgress readProgress;
+            readProgress.currentByte = 2; // Skip the DHT marker
+            jpeg::HuffmanEncoder::decodeHeaderEntropyTables(tables, readProgress, specifications);
+        }
+        scanData.setByteStuffing(true);
+        jpeg::ProgressiveHuffmanEncoder::IntervalEncoder intervalEncoder(progressiveEncoder, scanData);
+        for (auto const& block : blocks){
+            for (size_t component = 0 ; component < 3 ; ++component){
+                if (scan.includesComponent(component)){
+                    intervalEncoder.encode(block[component], component, component == 0);
+                }
+            }
+        }
+        intervalEncoder.finish();
+        scanData.pushIntoAlignment();
+
+        jpeg::BitReader reader(scanData.getBytes(), 0);
+        decodeProgressiveScan(reader, scan, specifications, decodedBlocks);
+        misreadScans += reader.getAlignedPosition() != scanData.getSize();
+    }
+    size_t mismatches = 0;
+    for (size_t block = 0 ; block < numBlocks ; ++block){
+        for (size_t component = 0 ; component < 3 ; ++component){
+            mismatches += decodedBlocks[block][component].m_data != blocks[block][component].m_data;
+        }
+    }
+    std::cout << "  " << mismatches << " mismatched blocks | " << misreadScans << " scans not read to their end\n";
+    return mismatches == 0 && misreadScans == 0;
+}
+
+int main(int argc, char *argv[]){
+    std::vector<std::string> arguments(argv + 1, argv + argc);
+    int qualityValue = 80;
+    uint16_t width = 4096, height = 4096;
+    unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    uint16_t restartInterval = 4;
+    std::string inputBmpImagePath;
+    for(auto arg = arguments.begin() ; arg != arguments.end() ; ++arg){
+        if (arg == arguments.end() - 1){
+            break;
+        }
+        else if (strcmp(arg->c_str(), "-i") == 0){
+            inputBmpImagePath = *(++arg);
+        }
+        else if (strcmp(arg->c_str(), "-q") == 0){
+            qualityValue = std::stoi(*(++arg));
+        }
+        else if (strcmp(arg->c_str(), "-w") == 0){
+            width = std::stoi(*(++arg));
+        }
+        else if (strcmp(arg->c_str(), "-h") == 0){
+            height = std::stoi(*(++arg));
+        }
+        else if (strcmp(arg->c_str(), "-t") == 0){
+            maxThreads = std::max(1, std::stoi(*(++arg)));
+        }
+        else if (strcmp(arg->c_str(), "-r") == 0){
+            restartInterval = std::max(1, std::stoi(*(++arg)));
+        }
+    }
+
+    jpeg::BitmapImageRGB inputBmp = inputBmpImagePath.empty() ? createSyntheticImage(width, height) : jpeg::BitmapImageRGB(inputBmpImagePath);
+    if (inputBmp.m_width == 0 || inputBmp.height == 0){
+        return EXIT_FAILURE;
+    }
+    std::cout << "Image: " << inputBmp.m_width << "x" << inputBmp.height << " | Quality: " << qualityValue << "\n";
+
+    benchmarkThreadedEncoding(inputBmp, qualityValue, maxThreads, restartInterval);
+    benchmarkThreadedDecoding(inputBmp, qualityValue, maxThreads, restartInterval);
+    benchmarkScaledDecoding(inputBmp, qualityValue);
+    benchmarkTrellisQuantisation(inputBmp, qualityValue);
+    bool const optimisedHuffmanTablesMatch = benchmarkOptimisedHuffmanTables(inputBmp, qualityValue);
+    bool const arithmeticCodingMatches = benchmarkArithmeticCoding(inputBmp, qualityValue);
+    benchmarkProgressiveEncoding(inputBmp, qualityValue);
+    benchmarkTargetSizeEncoding(inputBmp, qualityValue);
+    benchmarkBatchEncoding(maxThreads);
+    benchmarkStaticEncoding(inputBmp, qualityValue);
+    benchmarkImageViewEncoding(inputBmp, qualityValue);
+    benchmarkBufferSinkEncoding(inputBmp, qualityValue);
+    benchmarkTransforms(inputBmp, qualityValue);
+    bool const simdTransformsMatch = checkSimdTransforms();
+    bool const simdQuantisersMatch = checkSimdQuantisers();
+    bool const sparseInverseTransformsMatch = checkSparseInverseTransforms();
+    bool const sharedDecoderMatches = checkSharedDecoder(createSyntheticImage(256, 256));
+    bool const fillBytesMatch = checkFillBytes(createSyntheticImage(256, 256));
+    bool const progressiveScansMatch = checkProgressiveScans();
+    return (optimisedHuffmanTablesMatch && arithmeticCodingMatches && simdTransformsMatch && simdQuantisersMatch && sparseInverseTransformsMatch && sharedDecoderMatches && fillBytesMatch && progressiveScansMatch) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,36 @@
+#ifndef _JPEG_BATCH_ENCODER_HPP_
+#define _JPEG_BATCH_ENCODER_HPP_
+
+#include <vector>
+#include <span>
+#include <map>
+#include <memory>
+#include <thread>
+
+#include "encoder.hpp"
+#include "worker_pool.hpp"
+
+namespace jpeg{
+
+    /* Encodes batches of images on a fixed-size pool of worker threads, returning the JPEGs in input order.
+       Each worker keeps a BaselineEncoder for every quality value it has encountered, so the quantisation
+       matrices and Huffman lookups are built at most once per worker and quality, rather than once per image. */
+    class BatchEncoder{
+    public:
+        BatchEncoder(unsigned int numThreads = std::thread::hardware_concurrency());
+        BatchEncoder(BatchEncoder const&) = delete;
+        BatchEncoder(BatchEncoder const&&) = delete;
+        BatchEncoder& operator=(BatchEncoder const&) = delete;
+        BatchEncoder& operator=(BatchEncoder const&&) = delete;
+        ~BatchEncoder() = default;
+        std::vector<JPEGImage> encode(std::span<BitmapImageRGB const> inputImages, std::span<int const> qualities);
+        std::vector<JPEGImage> encode(std::span<BitmapImageRGB const> inputImages, int quality);
+    private:
+        BaselineEncoder& getEncoder(size_t worker, int quality);
+    private:
+        WorkerPool m_workerPool;
+        std::vector<std::map<int, std::unique_ptr<BaselineEncoder>>> m_workerEncoders;
+    };
+}
+
+#endif
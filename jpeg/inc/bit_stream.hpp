@@ -5,6 +5,10 @@
 #include <cstdint>
 #include <cassert>
 #include <iostream>
+#include <span>
+#include <algorithm>
+
+#include "output_sink.hpp"
 
 namespace jpeg{
 
@@ -15,34 +19,103 @@ namespace jpeg{
         BitStreamReadProgress();
         void reset();
         void advanceBits(size_t numBits);
-        void advanceBit();
         void advanceIntoAlignment();
     };
 
-    /* A stream to which up to 16 bits can be pushed at a time.
-       A vector of bytes representing the stream is retrievable as output. */
+    /* A stream to which up to 16 bits (or 32, with pushBitsu32) can be pushed at a time.
+       A vector of bytes representing the stream is retrievable as output. Pushed bits are collected in a 64-bit
+       accumulator, from which each byte is written to the stream as soon as it is complete. While byte stuffing is
+       enabled (as it is for entropy-coded data), a 0x00 byte is stuffed after each 0xFF byte as it is written. */
     class BitStream{
     public:
         BitStream();
         void clearStream();
-        size_t getSize();
+        void reserve(size_t numBytes);
+        size_t getSize() const;
         void pushBitsu8(uint8_t data, size_t numberOfBitsToPush);
         void pushBitsu16(uint16_t data, size_t numberOfBitsToPush);
+        void pushBitsu32(uint32_t data, size_t numberOfBitsToPush);
         uint8_t readByte(size_t byte) const;
         void pushByte(uint8_t data);
         void pushWord(uint16_t data);
         void pushIntoAlignment();
-        bool readNextBit(BitStreamReadProgress& progress) const;
+        void setByteStuffing(bool byteStuffing);
+        void append(BitStream const& other);
+        void flushCompleteBytes(OutputSink& sink);
         uint8_t readNextAlignedByte(BitStreamReadProgress& progress) const;
         uint16_t readNextAlignedWord(BitStreamReadProgress& progress) const;
         uint8_t const* getDataPtr() const;
-        void stuffBytes(size_t from);
-        void removeStuffedBytes(BitStreamReadProgress const& progress);
+        std::span<uint8_t const> getBytes() const;
+        std::vector<size_t> findRestartMarkers(size_t startOfScanData) const;
+        size_t findNextMarker(size_t position) const;
+        size_t skipFillBytes(size_t position) const;
     private:
-        uint8_t m_buffer;
-        size_t m_bitsInBuffer;
+        uint64_t m_accumulator;
+        size_t m_bitsInAccumulator;
+        bool m_byteStuffing;
         std::vector<uint8_t> m_stream;
     };
+
+    /* Reads entropy-coded data in place from a span of bytes. Bits are read from a 64-bit buffer, which is refilled
+       several bytes at a time, with the 0x00 stuffed after each 0xFF byte removed as the buffer is refilled. 
+       Refilling stops at a marker, which is left unread - any bits read beyond it are 0 bits. */
+    class BitReader{
+    public:
+        BitReader(std::span<uint8_t const> data, size_t position);
+        uint32_t peekBits(size_t numBits);
+        void skipBits(size_t numBits);
+        size_t getAlignedPosition() const;
+    private:
+        void refill();
+    private:
+        std::span<uint8_t const> m_data;
+        size_t m_position; // The next byte to be loaded into the buffer
+        uint64_t m_buffer;
+        size_t m_bitsInBuffer;
+        size_t m_bitsReadBeyondMarker;
+        bool m_markerReached;
+    };
+
+    /* The reading functions are defined here, so that they may be inlined into the entropy decoder */
+
+    /* Returns the next numBits (at most 32) bits, without advancing past them */
+    inline uint32_t BitReader::peekBits(size_t numBits){
+        assert(numBits <= 32);
+        if (m_bitsInBuffer < numBits){
+            refill();
+            if (m_bitsInBuffer < numBits){
+                return uint32_t((m_buffer << (numBits - m_bitsInBuffer)) & ((uint64_t(1) << numBits) - 1));
+            }
+        }
+        return uint32_t((m_buffer >> (m_bitsInBuffer - numBits)) & ((uint64_t(1) << numBits) - 1));
+    }
+
+    inline void BitReader::skipBits(size_t numBits){
+        if (m_bitsInBuffer < numBits){
+            refill();
+            if (m_bitsInBuffer < numBits){
+                m_bitsReadBeyondMarker += numBits - m_bitsInBuffer;
+                m_bitsInBuffer = numBits;
+            }
+        }
+        m_bitsInBuffer -= numBits;
+    }
+
+    /* Pushes up to 32 bits at once, e.g. a Huffman code together with its additional bits. Defined here, so that it
+       may be inlined into the entropy encoder. */
+    inline void BitStream::pushBitsu32(uint32_t data, size_t numberOfBitsToPush){
+        assert(numberOfBitsToPush <= 32);
+        m_accumulator = (m_accumulator << numberOfBitsToPush) | (data & ((uint64_t(1) << numberOfBitsToPush) - 1));
+        m_bitsInAccumulator += numberOfBitsToPush;
+        while (m_bitsInAccumulator >= 8){
+            m_bitsInAccumulator -= 8;
+            uint8_t const byte = uint8_t(m_accumulator >> m_bitsInAccumulator);
+            m_stream.push_back(byte);
+            if (m_byteStuffing && byte == 0xFF){
+                m_stream.push_back(0x00);
+            }
+        }
+    }
 }
 
 #endif
\ No newline at end of file
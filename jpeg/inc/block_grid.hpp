@@ -4,9 +4,13 @@
 #include <cstdint>
 #include <cstring>
 #include <array>
+#include <algorithm>
 #include <iterator>
+#include <atomic>
+#include <cassert>
 
 #include "bitmap_image.hpp"
+#include "image_view.hpp"
 
 namespace jpeg{
 
@@ -20,55 +24,81 @@ public:
         std::array<BitmapImageRGB::PixelData, blockElements> m_blockPixelData;
     };
 };
+/* The row-major index of each coefficient of a block, in zig-zag order. The zig-zag order visits each anti-diagonal
+   in turn, heading up and to the right along even anti-diagonals and down and to the left along odd ones. */
+inline constexpr std::array<uint8_t, BlockGrid::blockElements> zigZagIndices = []{
+    std::array<uint8_t, BlockGrid::blockElements> indices{};
+    size_t zigZagIndex = 0;
+    for (size_t diagonal = 0 ; diagonal < 2 * BlockGrid::blockSize - 1 ; ++diagonal){
+        size_t const firstRow = diagonal < BlockGrid::blockSize ? 0 : diagonal - (BlockGrid::blockSize - 1);
+        size_t const lastRow = std::min<size_t>(diagonal, BlockGrid::blockSize - 1);
+        for (size_t i = 0 ; i <= lastRow - firstRow ; ++i){
+            size_t const row = diagonal % 2 == 0 ? lastRow - i : firstRow + i;
+            indices[zigZagIndex++] = uint8_t(row * BlockGrid::blockSize + diagonal - row);
+        }
+    }
+    return indices;
+}();
+/* Splits an image into blocks, reading directly from the viewed pixel data. Partial blocks at the right and 
+   bottom edges are padded by repeating the last column and row. */
 class InputBlockGrid : public BlockGrid{
     public:
-        InputBlockGrid(BitmapImageRGB const& input);
+        InputBlockGrid(ImageView const& input);
         // Input iterator for accessing image blocks
         struct BlockIterator{
             using difference_type = std::ptrdiff_t;
             using value_type = BlockGrid::Block;
-            using underlying_type = BitmapImageRGB::PixelData;
-            using underlying_pointer = underlying_type const *;
             using iterator_category = std::input_iterator_tag;
         private:
-            underlying_pointer m_ptr; // Points to first (i.e. upper-left) pixel in block
+            ImageView m_image;
             uint16_t m_blockRowPos, m_blockColPos; // Position in block-rows and block-columns
-            uint16_t m_gridWidth, m_gridHeight;
+            uint16_t m_numBlockRows, m_numBlockCols;
         public:
-            explicit BlockIterator() = default;
-            BlockIterator(underlying_pointer p, uint16_t w, uint16_t h);
+            explicit BlockIterator() : m_image{nullptr, 0, 0, 0, PixelFormat::RGB24}{}
+            BlockIterator(ImageView const& image, uint16_t blockRow = 0);
             value_type operator*() const;
             BlockIterator& operator++();
             BlockIterator operator++(int);
-            friend bool operator==(BlockIterator const& a, BlockIterator const& b){return a.m_ptr == b.m_ptr;}
-            friend bool operator!=(BlockIterator const& a, BlockIterator const& b){return a.m_ptr != b.m_ptr;}
+            friend bool operator==(BlockIterator const& a, BlockIterator const& b){
+                return a.m_blockRowPos == b.m_blockRowPos && a.m_blockColPos == b.m_blockColPos;
+            }
+            friend bool operator!=(BlockIterator const& a, BlockIterator const& b){return !(a == b);}
             bool isLastCol() const;
             bool isLastRow() const;
-            underlying_pointer getDataPtr() const;
         };
         static_assert(std::input_iterator<BlockIterator>);
         
     public:
         BlockIterator begin() const;
         BlockIterator end() const;
+        BlockIterator beginBlockRow(uint16_t blockRow) const;
+        uint16_t getNumBlockRows() const;
+        uint16_t getNumBlockCols() const;
     private:
-        BitmapImageRGB const& m_imageData;
+        ImageView m_imageData;
     };
 
+    /* Assembles decoded blocks into a bitmap. Blocks are indexed in raster order, and distinct blocks
+       may be processed concurrently. If the image is decoded at a reduced scale of 1/scaleDenominator, each 
+       block holds only its first (blockSize / scaleDenominator)^2 pixels, in raster order, and the bitmap is
+       reduced to the given width and height divided by scaleDenominator (rounded up). */
     class OutputBlockGrid : public BlockGrid{
     private:
         BitmapImageRGB m_output;
-        InputBlockGrid m_blockGrid;
-        InputBlockGrid::BlockIterator m_currentBlock;
         uint16_t const m_gridWidth, m_gridHeight;
+        uint8_t const m_outputBlockSize;
+        uint16_t const m_numBlockCols, m_numBlockRows;
+        size_t m_nextBlock;
+        std::atomic<size_t> m_processedBlocks;
     public:
         OutputBlockGrid() = delete;
-        OutputBlockGrid(uint16_t width, uint16_t height);
+        OutputBlockGrid(uint16_t width, uint16_t height, uint8_t scaleDenominator = 1);
         void processNextBlock(BlockGrid::Block const& inputBlock);
+        void processBlock(size_t blockIndex, BlockGrid::Block const& inputBlock);
+        size_t getNumBlocks() const;
+        uint8_t getOutputBlockSize() const;
         BitmapImageRGB getBitmapRGB() const;
         bool atEnd() const;
-    private:
-        BitmapImageRGB::PixelData* getBlockPtr();
     };
 }
 #endif
\ No newline at end of file
@@ -36,6 +36,7 @@ namespace jpeg{
         ColourMappedBlockData applyMapping(BlockGrid::Block const& inputBlock) const override;
         BlockGrid::Block reverseMapping(ColourMappedBlockData const& inputBlock) const override;
         bool componentIsLuminance(uint8_t component) const override;
+        template <typename, typename, typename, typename> friend class StaticEncoder;
     };
 
     class RGBToYCbCrMapper : public ColourMapper{
@@ -43,6 +44,7 @@ namespace jpeg{
         ColourMappedBlockData applyMapping(BlockGrid::Block const& inputBlock) const override;
         BlockGrid::Block reverseMapping(ColourMappedBlockData const& inputBlock) const override;
         bool componentIsLuminance(uint8_t component) const override;
+        template <typename, typename, typename, typename> friend class StaticEncoder;
     };
 }
 #endif
\ No newline at end of file
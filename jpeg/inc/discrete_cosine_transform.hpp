@@ -5,14 +5,18 @@
 #include <span>
 #include <cmath>
 #include <numbers>
+#include <memory>
+#include <algorithm>
 
 #include "colour_mapping.hpp"
 #include "block_grid.hpp"
+#include "simd.hpp"
 namespace jpeg{
 
     /* Stores the results of performing a 2D DCT on a a single channel of a block */
     struct DctBlockChannelData{
             std::array<float, BlockGrid::blockElements> m_data;
+            uint8_t m_nonZeroExtent = BlockGrid::blockSize; // As for QuantisedBlockChannelData
             float getDCCoefficient(){return m_data.front();}
     };
 
@@ -26,12 +30,21 @@ namespace jpeg{
         virtual ~DiscreteCosineTransformer() = default;
     public:
         DctBlockChannelData transform(ColourMappedBlockData::BlockChannelData const& inputChannel) const;
-        ColourMappedBlockData::BlockChannelData inverseTransform(DctBlockChannelData  const& inputChannel) const;
+        ColourMappedBlockData::BlockChannelData inverseTransform(DctBlockChannelData  const& inputChannel, uint8_t outputSize = BlockGrid::blockSize) const;
+        /* Transforms which leave a known factor in each coefficient (e.g. to save multiplications) report it here, 
+           so that it can be folded into the quantisation tables. The forward factors scale the output of transform(), 
+           and the inverse factors are those expected to be present in the input of inverseTransform(). */
+        virtual std::array<float, BlockGrid::blockElements> getForwardScaleFactors() const;
+        virtual std::array<float, BlockGrid::blockElements> getInverseScaleFactors() const;
+        /* True if the forward transform (including its scale factors) only ever produces integral coefficients */
+        virtual bool hasIntegerCoefficients() const {return false;}
     protected:
         std::array<int8_t, BlockGrid::blockElements> applyOffset(ColourMappedBlockData::BlockChannelData const& input) const;
         virtual DctBlockChannelData applyTransform(std::array<int8_t, BlockGrid::blockElements> const& inputChannel) const = 0;
         ColourMappedBlockData::BlockChannelData removeOffset(std::array<int8_t, BlockGrid::blockElements> const& input) const;
         virtual std::array<int8_t, BlockGrid::blockElements> applyInverseTransform(DctBlockChannelData  const& inputChannel) const = 0;
+        virtual std::array<int8_t, BlockGrid::blockElements> applyScaledInverseTransform(DctBlockChannelData const& inputChannel, uint8_t outputSize) const;
+        template <typename, typename, typename, typename> friend class StaticEncoder;
     };
 
     /* Calculates the 2D DCT/IDCT by direct calculation in O(blockSize^4). */
@@ -39,20 +52,100 @@ namespace jpeg{
     protected:
         DctBlockChannelData applyTransform(std::array<int8_t, BlockGrid::blockElements> const& inputChannel) const override;
         std::array<int8_t, BlockGrid::blockElements> applyInverseTransform(DctBlockChannelData  const& inputChannel) const override;
+        template <typename, typename, typename, typename> friend class StaticEncoder;
     };
 
     /* Exploits separability of the 2D DCT/IDCT to split calculation into row and column transforms,
        thereby reducing complexity to O(blockSize^3). Further speedup may be achieved by using a more 
-       efficient 1D transformer. */
+       efficient 1D transformer. The inverse transform skips the frequencies outside of the non-zero extent
+       of its input, which gives identical results, as only zero terms are left out of each sum. */
     class SeparatedDiscreteCosineTransformer : public DiscreteCosineTransformer{
     protected:
         DctBlockChannelData applyTransform(std::array<int8_t, BlockGrid::blockElements> const& inputChannel) const override;
         std::array<int8_t, BlockGrid::blockElements> applyInverseTransform(DctBlockChannelData  const& inputChannel) const override;
+        template <typename, typename, typename, typename> friend class StaticEncoder;
     private:
         void apply1DTransformRow(int8_t const* src, float* dest, uint8_t u) const;
         void apply1DTransformCol(float const* src, float* dest, uint8_t v) const;
+        template <size_t extent>
+        std::array<int8_t, BlockGrid::blockElements> applySparseInverseTransform(DctBlockChannelData const& inputChannel) const;
+        template <size_t extent>
         void apply1DInverseTransformRow(float const* src, float* dest, uint8_t x) const;
+        template <size_t extent>
         void apply1DInverseTransformCol(float const* src, int8_t* dest, uint8_t y) const;
     };    
+
+    /* Calculates the 2D DCT/IDCT using the factorised 8-point transforms of Arai, Agui and Nakajima, which require
+       only 5 multiplications per 1D transform. The remaining per-coefficient scale factors are not applied, but are 
+       reported so that the quantiser can fold them into its tables. SSE2 and AVX2 kernels transform all 8 rows (or
+       columns) of a block at once, and are used if supported by the CPU, unless a lower SIMD level is requested. 
+       Each kernel performs the same operations in the same order, so all give identical results. */
+    class AANDiscreteCosineTransformer : public DiscreteCosineTransformer{
+    public:
+        AANDiscreteCosineTransformer(SimdLevel simdLevel = getPreferredSimdLevel());
+        SimdLevel getSimdLevel() const;
+        std::array<float, BlockGrid::blockElements> getForwardScaleFactors() const override;
+        std::array<float, BlockGrid::blockElements> getInverseScaleFactors() const override;
+    protected:
+        DctBlockChannelData applyTransform(std::array<int8_t, BlockGrid::blockElements> const& inputChannel) const override;
+        std::array<int8_t, BlockGrid::blockElements> applyInverseTransform(DctBlockChannelData  const& inputChannel) const override;
+        std::array<int8_t, BlockGrid::blockElements> applyScaledInverseTransform(DctBlockChannelData const& inputChannel, uint8_t outputSize) const override;
+        template <typename, typename, typename, typename> friend class StaticEncoder;
+    private:
+        void apply1DTransform(float* data, size_t stride) const;
+        void apply1DInverseTransform(float* data, size_t stride) const;
+        float static getAANScaleFactor(size_t frequency);
+#if JPEG_SIMD_X86
+        void static applyTransformSSE2(int8_t const* input, float* output);
+        void static applyInverseTransformSSE2(float const* input, int8_t* output);
+        void static applyTransformAVX2(int8_t const* input, float* output);
+        void static applyInverseTransformAVX2(float const* input, int8_t* output);
+#endif
+    private:
+        SimdLevel const m_simdLevel;
+        std::array<float, BlockGrid::blockElements> const m_inverseScaleFactors;
+    };
+
+    /* Calculates the 2D DCT/IDCT in 32-bit fixed-point arithmetic, using the factorisation of Loeffler, Ligtenberg 
+       and Moschytz (as in libjpeg's 'islow' transforms). As no floating-point arithmetic is involved, the results
+       are bit-exact on every platform and build. The forward transform leaves each coefficient scaled by 8. */
+    class IntegerDiscreteCosineTransformer : public DiscreteCosineTransformer{
+    public:
+        std::array<float, BlockGrid::blockElements> getForwardScaleFactors() const override;
+        bool hasIntegerCoefficients() const override {return true;}
+    protected:
+        DctBlockChannelData applyTransform(std::array<int8_t, BlockGrid::blockElements> const& inputChannel) const override;
+        std::array<int8_t, BlockGrid::blockElements> applyInverseTransform(DctBlockChannelData  const& inputChannel) const override;
+        template <typename, typename, typename, typename> friend class StaticEncoder;
+    private:
+        template <int shiftEven, int shiftOdd>
+        void apply1DTransform(int32_t* data, size_t stride) const;
+        template <int shift>
+        void apply1DInverseTransform(int32_t* data, size_t stride) const;
+        int32_t static descale(int32_t value, int shift){return (value + (int32_t(1) << (shift - 1))) >> shift;}
+        // Fixed-point constants, with 13 fractional bits
+        int const static constBits = 13;
+        int const static pass1Bits = 2;
+        int32_t const static fix_0_298631336 = 2446;
+        int32_t const static fix_0_390180644 = 3196;
+        int32_t const static fix_0_541196100 = 4433;
+        int32_t const static fix_0_765366865 = 6270;
+        int32_t const static fix_0_899976223 = 7373;
+        int32_t const static fix_1_175875602 = 9633;
+        int32_t const static fix_1_501321110 = 12299;
+        int32_t const static fix_1_847759065 = 15137;
+        int32_t const static fix_1_961570560 = 16069;
+        int32_t const static fix_2_053119869 = 16819;
+        int32_t const static fix_2_562915447 = 20995;
+        int32_t const static fix_3_072711026 = 25172;
+    };
+
+    /* Transformers which may be selected when constructing a BaselineEncoder */
+    enum class DctMethod{
+        Separated,
+        AAN,
+        Integer
+    };
+    std::unique_ptr<DiscreteCosineTransformer> createDiscreteCosineTransformer(DctMethod method);
 }
 #endif
\ No newline at end of file
@@ -6,8 +6,14 @@
 #include <string>
 #include <chrono>
 #include <memory>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
 
 #include "bitmap_image.hpp"
+#include "image_view.hpp"
 #include "jpeg_image.hpp"
 #include "block_grid.hpp"
 #include "colour_mapping.hpp"
@@ -15,8 +21,50 @@
 #include "quantiser.hpp"
 #include "entropy_encoder.hpp"
 #include "markers.hpp"
+#include "output_sink.hpp"
+#include "worker_pool.hpp"
 
 namespace jpeg{
+    /* Options controlling the structure of an encoded JPEG. If the restart interval is non-zero, the image is 
+       split into horizontal strips of that many block-rows, separated by restart markers. Each strip is 
+       entropy-coded independently, so strips may be distributed between worker threads. The output depends
+       only on the restart interval, and is byte-identical for any number of threads. If trellis quantisation is
+       enabled, the AC coefficients of each block are chosen to minimise distortion plus rate (see
+       EntropyEncoder::optimiseQuantisation), rather than rounded. If Huffman table optimisation is enabled, the
+       image is quantised in a first pass which counts the symbols to be coded, and is entropy-coded in a second
+       pass with tables built for those counts, rather than with the typical tables of Annex K. If arithmetic coding
+       is enabled, the quantised image is instead coded with the adaptive arithmetic coder (SOF9), which usually gives
+       smaller output than either, but is slower to encode and decode and is not supported by every decoder. If
+       progressive encoding is enabled, the quantised image is coded as a progressive JPEG (SOF2) in the standard
+       sequence of scans (see ProgressiveHuffmanEncoder::standardScans), from which a decoder can show a coarse
+       preview after the first scan. The tables of each scan are always optimised, and arithmetic coding is not
+       supported. This library decodes sequential JPEGs only. */
+    struct EncodeOptions{
+        uint16_t m_restartIntervalBlockRows = 0;
+        unsigned int m_numThreads = 1;
+        bool m_trellisQuantisation = false;
+        bool m_optimiseHuffmanTables = false;
+        bool m_arithmeticCoding = false;
+        bool m_progressive = false;
+    };
+
+    /* Options controlling how a JPEG is decoded. If the JPEG contains restart intervals, these are decoded
+       concurrently on up to the given number of threads. A scale denominator of 2, 4 or 8 decodes the image at
+       1/2, 1/4 or 1/8 of its size (rounded up), using reduced-size inverse transforms of each block. */
+    struct DecodeOptions{
+        unsigned int m_numThreads = 1;
+        uint8_t m_scaleDenominator = 1;
+    };
+
+    /* The quantiser and entropy decoder for the tables read from the header of a JPEG. Exactly one of the decoders
+       is set: Huffman-coded blocks are decoded one at a time, while arithmetic-coded blocks can only be decoded in 
+       turn by an interval decoder, so the two share no interface for decoding blocks. */
+    struct DecodingTables{
+        std::unique_ptr<Quantiser> m_quantiser;
+        std::unique_ptr<EntropyEncoder> m_entropyEncoder;
+        std::unique_ptr<ArithmeticEncoder> m_arithmeticEncoder;
+    };
+
     class Encoder{
     public:
         Encoder(Encoder const&) = delete;
@@ -28,23 +76,63 @@ namespace jpeg{
                        std::unique_ptr<DiscreteCosineTransformer> discreteCosineTransformer,
                        std::unique_ptr<Quantiser> quantiser,
                        std::unique_ptr<EntropyEncoder> entropyEncoder);
-        void encode(BitmapImageRGB const& inputImage, JPEGImage& outputImage);
-        void decode(JPEGImage inputImage, BitmapImageRGB& outputImage);
+        void encode(BitmapImageRGB const& inputImage, JPEGImage& outputImage, EncodeOptions const& options = {});
+        void encode(ImageView const& inputImage, JPEGImage& outputImage, EncodeOptions const& options = {});
+        void encode(ImageView const& inputImage, OutputSink& outputSink, EncodeOptions const& options = {});
+        int encodeToSize(BitmapImageRGB const& inputImage, JPEGImage& outputImage, size_t targetFileSize, EncodeOptions const& options = {});
+        int encodeToSize(ImageView const& inputImage, JPEGImage& outputImage, size_t targetFileSize, EncodeOptions const& options = {});
+        void decode(JPEGImage const& inputImage, BitmapImageRGB& outputImage, DecodeOptions const& options = {});
     private:
-        void encodeHeader(BitmapImageRGB const& inputImage, BitStream& outputStream, std::unique_ptr<Quantiser> const& quantiser, std::unique_ptr<EntropyEncoder> const& entropyEncoder) const;
-        void decodeHeader(BitStream const& inputStream, BitStreamReadProgress& readProgress, BitmapImageRGB& outputImage) const;
+        void static encodeHeader(uint16_t width, uint16_t height, BitStream& outputStream, Quantiser const& quantiser, EntropyHeaderEncoder const& entropyEncoder, uint16_t restartInterval);
+        void static encodeFrameHeader(uint16_t width, uint16_t height, BitStream& outputStream, Quantiser const& quantiser, uint16_t startOfFrameMarker);
+        void static encodeRestartIntervalDefinition(BitStream& outputStream, uint16_t restartInterval);
+        void static encodeScanHeader(BitStream& outputStream, ScanParameters const& scan);
+        std::shared_ptr<DecodingTables const> decodeHeader(BitStream const& inputStream, BitStreamReadProgress& readProgress, BitmapImageRGB& outputImage, uint16_t& restartInterval) const;
+        std::shared_ptr<DecodingTables const> getDecodingTables(QuantisationTable const& luminanceMatrix, QuantisationTable const& chrominanceMatrix,
+                                                                std::array<HuffmanTableSpecification const*, 4> const& huffmanTables,
+                                                                std::optional<std::array<ArithmeticConditioning, 2>> const& arithmeticConditioning = std::nullopt) const;
+        /* Entropy-codes the block-rows [firstBlockRow, lastBlockRow) into a stream */
+        using StripEncoder = std::function<void(size_t firstBlockRow, size_t lastBlockRow, std::array<int16_t, 3>& lastDCValues, BitStream& outputStream)>;
+        using TransformedBlock = std::array<DctBlockChannelData, 3>;
+        using QuantisedBlock = std::array<QuantisedBlockChannelData, 3>;
+        void static validateOptions(EncodeOptions const& options);
+        void encodeWholeImage(ImageView const& inputImage, JPEGImage& outputImage, EncodeOptions const& options) const;
+        void encodeImage(uint16_t width, uint16_t height, size_t numBlockRows, Quantiser const& quantiser, EntropyHeaderEncoder const& entropyEncoder, uint16_t restartInterval, EncodeOptions const& options, StripEncoder const& encodeStrip, JPEGImage& outputImage) const;
+        void encodeOptimisedImage(uint16_t width, uint16_t height, size_t numBlockCols, std::vector<QuantisedBlock> const& blocks, Quantiser const& quantiser, uint16_t restartInterval, EncodeOptions const& options, JPEGImage& outputImage) const;
+        void encodeArithmeticImage(uint16_t width, uint16_t height, size_t numBlockCols, std::vector<QuantisedBlock> const& blocks, Quantiser const& quantiser, uint16_t restartInterval, EncodeOptions const& options, JPEGImage& outputImage) const;
+        void encodeProgressiveImage(uint16_t width, uint16_t height, size_t numBlockCols, std::vector<QuantisedBlock> const& blocks, Quantiser const& quantiser, uint16_t restartInterval, EncodeOptions const& options, JPEGImage& outputImage) const;
+        void encodeScan(size_t numBlockRows, uint16_t restartInterval, EncodeOptions const& options, StripEncoder const& encodeStrip, BitStream& outputStream) const;
+        std::vector<TransformedBlock> transformBlocks(InputBlockGrid const& blockGrid, EncodeOptions const& options) const;
+        std::vector<QuantisedBlock> quantiseBlocks(std::vector<TransformedBlock> const& coefficients, size_t numBlockCols, Quantiser const& quantiser, EncodeOptions const& options) const;
+        void encodeBlocks(InputBlockGrid::BlockIterator first, InputBlockGrid::BlockIterator last, std::array<int16_t, 3>& lastDCValues, BitStream& outputStream, bool trellisQuantisation = false) const;
+        void encodeBlockChannel(DctBlockChannelData const& dctData, bool isLuminance, Quantiser const& quantiser, int16_t& lastDCValue, BitStream& outputStream, bool trellisQuantisation) const;
+        QuantisedBlockChannelData quantiseBlockChannel(DctBlockChannelData const& dctData, bool isLuminance, Quantiser const& quantiser, bool trellisQuantisation) const;
+        StripEncoder getStripEncoder(InputBlockGrid const& blockGrid, EncodeOptions const& options) const;
+        uint16_t getRestartInterval(InputBlockGrid const& blockGrid, EncodeOptions const& options) const;
+        void encodeRestartStrips(size_t numBlockRows, EncodeOptions const& options, StripEncoder const& encodeStrip, BitStream& outputStream, OutputSink* outputSink = nullptr) const;
+        void decodeBlocks(BitReader& inputReader, size_t firstBlock, size_t lastBlock, DecodingTables const& tables, OutputBlockGrid& outputBlockGrid) const;
+        BlockGrid::Block decodeBlock(BitReader& inputReader, std::array<int16_t, 3>& lastDCValues, DecodingTables const& tables, uint8_t outputBlockSize = BlockGrid::blockSize) const;
+        BlockGrid::Block decodeBlock(ArithmeticEncoder::IntervalDecoder& intervalDecoder, DecodingTables const& tables, uint8_t outputBlockSize = BlockGrid::blockSize) const;
+        BlockGrid::Block reconstructBlock(QuantisedBlock const& quantisedBlock, DecodingTables const& tables, uint8_t outputBlockSize) const;
         bool virtual supportsSaving() const = 0;
+        friend class StreamingEncoder;
+        friend class StreamingDecoder;
+        template <typename, typename, typename, typename> friend class StaticEncoder;
     private:
         std::unique_ptr<ColourMapper> m_colourMapper;
         std::unique_ptr<DiscreteCosineTransformer> m_discreteCosineTransformer;
         std::unique_ptr<Quantiser> m_quantiser;
         std::unique_ptr<EntropyEncoder> m_entropyEncoder;
+        /* Decoding tables built from the headers of previously decoded JPEGs, keyed by the contents of their tables */
+        size_t const static maxCachedDecodingTables = 64;
+        mutable std::mutex m_decodingTablesMutex;
+        mutable std::unordered_map<std::string, std::shared_ptr<DecodingTables const>> m_decodingTables;
     };
 
     class BaselineEncoder final : public Encoder{
     public:
-        BaselineEncoder(int quality) : Encoder(std::make_unique<RGBToYCbCrMapper>(), 
-                                                             std::make_unique<SeparatedDiscreteCosineTransformer>(), 
+        BaselineEncoder(int quality, DctMethod dctMethod = DctMethod::Separated) : Encoder(std::make_unique<RGBToYCbCrMapper>(), 
+                                                             createDiscreteCosineTransformer(dctMethod), 
                                                              std::make_unique<Quantiser>(quality), 
                                                              std::make_unique<HuffmanEncoder>()){
         }
@@ -11,6 +11,8 @@
 #include <span>
 #include <algorithm>
 #include <numeric>
+#include <limits>
+#include <optional>
 
 #include "quantiser.hpp"
 #include "bit_stream.hpp"
@@ -21,70 +23,276 @@ namespace jpeg{
     struct RunLengthEncodedBlockChannelData{
         int16_t m_dcDifference;
         struct RunLengthEncodedACCoefficient{
-            size_t m_runLength;
+            uint8_t m_runLength;
             int16_t m_value;
             bool operator==(RunLengthEncodedACCoefficient const&) const = default;
         };
-        std::vector<RunLengthEncodedACCoefficient> m_acCoefficients;
+        /* Every entry (including the end of block) accounts for at least one of the 63 AC coefficients, so the
+           entries are held inline rather than allocated per block */
+        std::array<RunLengthEncodedACCoefficient, BlockGrid::blockElements - 1> m_acCoefficients;
+        uint8_t m_numACCoefficients = 0;
+        std::span<RunLengthEncodedACCoefficient const> getACCoefficients() const{
+            return std::span(m_acCoefficients).first(m_numACCoefficients);
+        }
     };
 
-    class EntropyEncoder{
+    /* A Huffman table as specified in a DHT segment: the number of codes of each length from 1 to 16 bits (BITS), 
+       and the symbols in order of increasing code length (HUFFVAL) */
+    struct HuffmanTableSpecification{
+        std::array<uint8_t, 16> m_codeLengthCounts;
+        std::vector<uint8_t> m_values;
+        bool operator==(HuffmanTableSpecification const&) const = default;
+    };
+
+    /* The number of occurrences of each Huffman symbol (SSSS for DC, RRRRSSSS for AC) in the blocks of an image, for
+       luminance (index 0) and chrominance (index 1) components */
+    struct SymbolFrequencies{
+        std::array<std::array<size_t, 256>, 2> m_dcFrequencies{}, m_acFrequencies{};
+    };
+
+    /* The parts of the header which depend on how blocks are entropy-coded: the start of frame marker of the coding
+       process, and the segments specifying its tables */
+    class EntropyHeaderEncoder{
     public:
-        EntropyEncoder() = default;
-        EntropyEncoder(EntropyEncoder const&) = delete;
-        EntropyEncoder(EntropyEncoder const&&) = delete;
-        EntropyEncoder& operator=(EntropyEncoder const&) = delete;
-        EntropyEncoder& operator=(EntropyEncoder const&&) = delete;
-        virtual ~EntropyEncoder() = default;
+        EntropyHeaderEncoder() = default;
+        EntropyHeaderEncoder(EntropyHeaderEncoder const&) = delete;
+        EntropyHeaderEncoder(EntropyHeaderEncoder const&&) = delete;
+        EntropyHeaderEncoder& operator=(EntropyHeaderEncoder const&) = delete;
+        EntropyHeaderEncoder& operator=(EntropyHeaderEncoder const&&) = delete;
+        virtual ~EntropyHeaderEncoder() = default;
     public:
-        void encode(QuantisedBlockChannelData const& input, int16_t& lastDCValue, BitStream& outputStream, bool isLuminanceComponent) const;
-        QuantisedBlockChannelData decode(BitStream const& inputStream, BitStreamReadProgress& readProgress, int16_t& lastDCValue, bool isLuminanceComponent) const;
         virtual void encodeHeaderEntropyTables(BitStream& outputStream) const = 0;
-        /* Issue: include decoding for non-default tables */
+        virtual uint16_t getStartOfFrameMarker() const;
+    };
+
+    /* Codes each block independently of the blocks before it (other than by its DC prediction) */
+    class EntropyEncoder : public EntropyHeaderEncoder{
+    public:
+        void encode(QuantisedBlockChannelData const& input, int16_t& lastDCValue, BitStream& outputStream, bool isLuminanceComponent) const;
+        virtual void encodeZigZag(QuantisedBlockChannelData const& zigZagInput, int16_t& lastDCValue, BitStream& outputStream, bool isLuminanceComponent) const;
+        QuantisedBlockChannelData decode(BitReader& inputReader, int16_t& lastDCValue, bool isLuminanceComponent) const;
+        void countSymbols(QuantisedBlockChannelData const& input, int16_t& lastDCValue, SymbolFrequencies& frequencies, bool isLuminanceComponent) const;
+        QuantisedBlockChannelData optimiseQuantisation(QuantisedBlockChannelData const& input, std::array<float, BlockGrid::blockElements> const& quotients, std::array<float, BlockGrid::blockElements> const& stepSizes, bool isLuminanceComponent) const;
+        uint8_t static getNonZeroExtent(size_t lastNonZeroIndex);
     private:
         QuantisedBlockChannelData mapFromGridToZigZag(QuantisedBlockChannelData const& input) const;
         QuantisedBlockChannelData mapFromZigZagToGrid(QuantisedBlockChannelData const& input) const;
         RunLengthEncodedBlockChannelData applyRunLengthEncoding(QuantisedBlockChannelData const& input, int16_t& lastDCValue) const;
-        QuantisedBlockChannelData removeRunLengthEncoding(RunLengthEncodedBlockChannelData const& input, int16_t& lastDCValue) const;
+        QuantisedBlockChannelData removeRunLengthEncoding(RunLengthEncodedBlockChannelData const& input, int16_t& lastDCValue, size_t& lastNonZeroIndex) const;
     protected:
         virtual void applyFinalEncoding(RunLengthEncodedBlockChannelData const& input, BitStream& outputStream, bool isLuminanceComponent) const = 0;
-        virtual RunLengthEncodedBlockChannelData removeFinalEncoding(BitStream const& inputStream, BitStreamReadProgress& readProgress, bool isLuminanceComponent) const = 0;
+        virtual RunLengthEncodedBlockChannelData removeFinalEncoding(BitReader& inputReader, bool isLuminanceComponent) const = 0;
+        /* The length in bits of the code for each AC symbol RRRRSSSS (zero if the symbol has no code) */
+        virtual std::array<uint8_t, 256> getACCodeLengths(bool isLuminanceComponent) const = 0;
+        template <typename, typename, typename, typename> friend class StaticEncoder;
     };
 
     class HuffmanEncoder : public EntropyEncoder{
     public:
-        HuffmanEncoder();
+        explicit HuffmanEncoder(SimdLevel simdLevel = getPreferredSimdLevel());
+        HuffmanEncoder(HuffmanTableSpecification const& luminanceDC, HuffmanTableSpecification const& luminanceAC,
+                       HuffmanTableSpecification const& chrominanceDC, HuffmanTableSpecification const& chrominanceAC,
+                       SimdLevel simdLevel = getPreferredSimdLevel());
+        explicit HuffmanEncoder(SymbolFrequencies const& frequencies, SimdLevel simdLevel = getPreferredSimdLevel());
+        SimdLevel getSimdLevel() const;
         void encodeHeaderEntropyTables(BitStream& outputStream) const override;
+        void static decodeHeaderEntropyTables(BitStream const& inputStream, BitStreamReadProgress& readProgress, std::array<std::optional<HuffmanTableSpecification>, 8>& specifications);
+        void encodeZigZag(QuantisedBlockChannelData const& zigZagInput, int16_t& lastDCValue, BitStream& outputStream, bool isLuminanceComponent) const override;
     protected:
         void applyFinalEncoding(RunLengthEncodedBlockChannelData const& input, BitStream& outputStream, bool isLuminanceComponent) const override;
-        RunLengthEncodedBlockChannelData removeFinalEncoding(BitStream const& inputStream, BitStreamReadProgress& readProgress, bool isLuminanceComponent) const override;
+        RunLengthEncodedBlockChannelData removeFinalEncoding(BitReader& inputReader, bool isLuminanceComponent) const override;
+        std::array<uint8_t, 256> getACCodeLengths(bool isLuminanceComponent) const override;
+        template <typename, typename, typename, typename> friend class StaticEncoder;
+        friend class ProgressiveHuffmanEncoder;
     private:
+        size_t const static lookaheadBits = 9;
         struct HuffmanTable{
             struct HuffmanCode{
-                size_t m_codeLength;
+                size_t m_codeLength; // Zero if the symbol has no code
                 uint16_t m_codeWord;
                 bool operator==(HuffmanCode const&) const = default;
             };
-            std::array<HuffmanCode const, 12> m_dcTable;
-            std::unordered_map<uint16_t, size_t> m_dcLookup;
-            std::array<std::array<HuffmanCode const, 10>, 16> m_acTable;
+            HuffmanTableSpecification m_dcSpecification, m_acSpecification;
+            std::array<HuffmanCode, 12> m_dcTable;
+            std::array<std::array<HuffmanCode, 10>, 16> m_acTable;
             HuffmanCode m_acEndOfBlock, m_acZeroRunLength;
-            struct HuffIndexAC{
-            size_t m_RRRR, m_SSSS;
+            /* Decodes the codes of one table. A code of up to lookaheadBits bits is decoded with a single lookup of
+               the next lookaheadBits bits of the stream, which also decodes its additional bits if they fit. Longer
+               codes are decoded by comparison with the largest code of each length, as in Figure F.16 of ITU-T81. */
+            struct DecodingTable{
+                struct LookupEntry{
+                    uint8_t m_codeLength = 0; // Zero if no code of up to lookaheadBits bits is a prefix of the index
+                    uint8_t m_decodedLength = 0; // Length of the code and its additional bits, or zero if these do not fit
+                    uint8_t m_symbol = 0;
+                    int16_t m_value = 0; // Value of the additional bits, if they fit
+                };
+                std::array<LookupEntry, 1 << lookaheadBits> m_lookup;
+                std::array<int32_t, 17> m_maxCode; // The largest code word of each length, or -1 if there are none
+                std::array<int32_t, 17> m_valueOffset; // Index in m_values of the symbol of each code word, less the code word
+                std::vector<uint8_t> m_values;
             };
-            std::unordered_map<uint16_t, HuffIndexAC> m_acLookup;
+            DecodingTable m_dcDecodingTable, m_acDecodingTable;
+        };
+        struct DecodedSymbol{
+            uint8_t m_symbol;
+            int16_t m_value;
         };
         HuffmanTable m_luminanceHuffTable;
         HuffmanTable m_chrominanceHuffTable;
+        SimdLevel m_simdLevel;
+        HuffmanTableSpecification static buildOptimisedSpecification(std::array<size_t, 256> const& frequencies);
+        HuffmanTable static buildHuffmanTable(HuffmanTableSpecification const& dcSpecification, HuffmanTableSpecification const& acSpecification);
+        void static addDecodingCode(HuffmanTable::DecodingTable& table, uint8_t symbol, HuffmanTable::HuffmanCode code);
         void pushHuffmanCodedDCDifferenceToStream(int16_t dcDifference, BitStream& outputStream, HuffmanTable const& huffTable) const;
         void pushHuffmanCodedACCoefficientToStream(RunLengthEncodedBlockChannelData::RunLengthEncodedACCoefficient acCoeff, BitStream& outputStream, HuffmanTable const& huffTable) const;
-        uint16_t static appendBit(uint16_t input, bool bit){return (input << 1) | uint16_t(bit);}
-        int16_t extractDCDifferenceFromStream(BitStream const& inputStream, BitStreamReadProgress& readProgress, HuffmanTable const& huffTable) const;
-        RunLengthEncodedBlockChannelData::RunLengthEncodedACCoefficient extractACCoefficientFromStream(BitStream const& inputStream, BitStreamReadProgress& readProgress, HuffmanTable const& huffTable) const;
+        void pushHuffmanCodedACValueToStream(uint8_t runLengthRRRR, int16_t acValue, BitStream& outputStream, HuffmanTable const& huffTable) const;
+        void pushHuffmanCodeToStream(HuffmanTable::HuffmanCode huffCode, BitStream& outputStream) const;
+        uint64_t getNonZeroMask(std::array<int16_t, BlockGrid::blockElements> const& coefficients) const;
+#if JPEG_SIMD_X86
+        uint64_t static getNonZeroMaskSSE2(int16_t const* coefficients);
+        uint64_t static getNonZeroMaskAVX2(int16_t const* coefficients);
+#endif
+        int16_t static extendAmplitude(uint32_t additionalBits, uint8_t categorySSSS);
+        DecodedSymbol extractSymbolFromStream(BitReader& inputReader, HuffmanTable::DecodingTable const& table) const;
+        int16_t extractAmplitudeFromStream(BitReader& inputReader, uint8_t categorySSSS) const;
+        int16_t extractDCDifferenceFromStream(BitReader& inputReader, HuffmanTable const& huffTable) const;
+        RunLengthEncodedBlockChannelData::RunLengthEncodedACCoefficient extractACCoefficientFromStream(BitReader& inputReader, HuffmanTable const& huffTable) const;
     };  
-    /* To be implemented! */
-    /* class ArithmeticEncoder : public EntropyEncoder{
-    }; */
+    /* The conditioning of the statistical models of the arithmetic coder for a component type, as specified in a DAC
+       segment. DC differences are classed as zero, small or large according to the bounds L and U on their magnitude
+       categories, and AC magnitudes are coded with separate statistics up to and beyond the zig-zag index Kx 
+       (Section F.1.4.4 of ITU-T81). */
+    struct ArithmeticConditioning{
+        uint8_t m_dcLowerBound = 0; // L
+        uint8_t m_dcUpperBound = 1; // U
+        uint8_t m_acThreshold = 5; // Kx
+        bool operator==(ArithmeticConditioning const&) const = default;
+    };
+
+    /* Codes blocks with the adaptive binary arithmetic coder of Annex D of ITU-T81 (the QM-coder), using the models 
+       of Section F.1.4 for sequential DCT-based coding, written with an SOF9 marker and a DAC segment. The probability
+       estimates adapt to the blocks coded so far, so the blocks of an interval (the scan, or the part of it between
+       restart markers) can only be coded in turn, by an IntervalEncoder or IntervalDecoder holding its state. */
+    class ArithmeticEncoder : public EntropyHeaderEncoder{
+    private:
+        /* The state of the models over an interval: a probability estimate for each binary decision (the index of its
+           row of Table D.2, with the sense of the more probable symbol in the top bit), and the DC prediction and 
+           conditioning context of each component */
+        struct ModelState{
+            std::array<std::array<uint8_t, 64>, 2> m_dcStatistics{};
+            std::array<std::array<uint8_t, 256>, 2> m_acStatistics{};
+            uint8_t m_fixedStatistic = 113; // A fixed estimate of 1/2, used for the signs of AC coefficients
+            std::array<int16_t, 3> m_lastDCValues{};
+            std::array<uint8_t, 3> m_dcContexts{};
+        };
+    public:
+        ArithmeticEncoder(ArithmeticConditioning const& luminanceConditioning = {}, ArithmeticConditioning const& chrominanceConditioning = {});
+        void encodeHeaderEntropyTables(BitStream& outputStream) const override;
+        uint16_t getStartOfFrameMarker() const override;
+        void static decodeHeaderEntropyTables(BitStream const& inputStream, BitStreamReadProgress& readProgress, std::array<uint8_t, 8>& conditioningValues);
+
+        /* Encodes the (grid-ordered) blocks of an interval into a byte-stuffed stream. The final bytes are only 
+           written by finish(). */
+        class IntervalEncoder{
+        public:
+            IntervalEncoder(ArithmeticEncoder const& arithmeticEncoder, BitStream& outputStream);
+            void encode(QuantisedBlockChannelData const& input, size_t component, bool isLuminanceComponent);
+            void finish();
+        private:
+            void encodeDecision(uint8_t& statistic, bool decision);
+            void pushBufferedBytes(bool carry);
+            void pushPendingZeroBytes();
+        private:
+            ArithmeticEncoder const& m_arithmeticEncoder;
+            BitStream& m_outputStream;
+            ModelState m_modelState;
+            uint32_t m_codeRegister; // C
+            uint32_t m_intervalRegister; // A
+            int m_bitsUntilByte; // CT
+            int m_bufferedByte; // The last complete byte, which a carry may yet increment (-1 if there is none)
+            size_t m_stackedFFBytes; // 0xFF bytes following the buffered byte, which a carry would turn into 0x00
+            size_t m_pendingZeroBytes; // 0x00 bytes which are only written if followed by a non-zero byte
+        };
+
+        /* Decodes the blocks of an interval. A marker ends the entropy-coded data, which is then read as 0 bits. */
+        class IntervalDecoder{
+        public:
+            IntervalDecoder(ArithmeticEncoder const& arithmeticEncoder, BitReader& inputReader);
+            QuantisedBlockChannelData decode(size_t component, bool isLuminanceComponent);
+        private:
+            bool decodeDecision(uint8_t& statistic);
+        private:
+            ArithmeticEncoder const& m_arithmeticEncoder;
+            BitReader& m_inputReader;
+            ModelState m_modelState;
+            uint32_t m_codeRegister; // C
+            uint32_t m_intervalRegister; // A
+            int m_bitsInCodeRegister; // CT
+        };
+    private:
+        std::array<ArithmeticConditioning, 2> m_conditioning; // Luminance, chrominance
+    };
+
+    /* The parameters of a scan (Section B.2.3 of ITU-T81), which codes the coefficients with zig-zag indices from Ss
+       to Se, from bit Al upwards. A sequential scan codes every coefficient (Ss = 0, Se = 63) in full (Ah = Al = 0).
+       A progressive scan codes either the DC coefficients (Ss = Se = 0) of every component, or a band of the AC 
+       coefficients of a single component. If Ah is non-zero, the scan refines the coefficients coded down to bit Ah 
+       by a previous scan by their next bit. */
+    struct ScanParameters{
+        uint8_t m_component = 0; // The component of a scan of AC coefficients only
+        uint8_t m_spectralStart = 0; // Ss
+        uint8_t m_spectralEnd = BlockGrid::blockElements - 1; // Se
+        uint8_t m_approximationHigh = 0; // Ah
+        uint8_t m_approximationLow = 0; // Al
+        bool includesComponent(size_t component) const{
+            return m_spectralStart == 0 || component == m_component;
+        }
+    };
+
+    /* Codes a scan of a progressive JPEG (SOF2) with Huffman tables, using the procedures of Section G.1.2 of ITU-T81.
+       The blocks of an AC band with nothing left to code are counted into runs, each coded as a single EOBn symbol,
+       which the typical tables of Annex K have no codes for. The tables of each scan are therefore always built for
+       the symbols that it contains, as libjpeg does. As runs span blocks, the blocks of an interval can only be coded
+       in turn, by an IntervalEncoder holding the current run and the correction bits that follow it. */
+    class ProgressiveHuffmanEncoder{
+    public:
+        /* The scans of libjpeg's jpeg_simple_progression() for YCbCr: DC and the first luminance AC coefficients 
+           first, at reduced precision, then the remaining AC coefficients, then the low bits of each */
+        std::array<ScanParameters, 10> const static standardScans;
+
+        ProgressiveHuffmanEncoder(ScanParameters const& scan, SymbolFrequencies const& frequencies);
+        void encodeHeaderEntropyTables(BitStream& outputStream) const;
+
+        /* Codes the (grid-ordered) blocks of an interval of a scan, or counts the symbols that coding them takes */
+        class IntervalEncoder{
+        public:
+            IntervalEncoder(ProgressiveHuffmanEncoder const& progressiveEncoder, BitStream& outputStream);
+            IntervalEncoder(ScanParameters const& scan, SymbolFrequencies& frequencies);
+            void encode(QuantisedBlockChannelData const& input, size_t component, bool isLuminanceComponent);
+            void finish();
+        private:
+            void encodeDCFirst(QuantisedBlockChannelData const& input, size_t component, bool isLuminanceComponent);
+            void encodeACFirst(QuantisedBlockChannelData const& input, bool isLuminanceComponent);
+            void encodeACRefinement(QuantisedBlockChannelData const& input, bool isLuminanceComponent);
+            void pushEndOfBandRun();
+            void pushSymbol(uint8_t symbol, bool isDC, bool isLuminanceComponent);
+            void pushBits(uint32_t bits, size_t numBits);
+        private:
+            ProgressiveHuffmanEncoder const* m_progressiveEncoder; // Null if only counting symbols
+            BitStream* m_outputStream;
+            SymbolFrequencies* m_frequencies;
+            ScanParameters m_scan;
+            std::array<int16_t, 3> m_lastDCValues{};
+            size_t m_endOfBandRun = 0; // EOBRUN - the blocks since the last coded coefficient which end in an EOB
+            bool m_endOfBandRunIsLuminance = true;
+            std::vector<uint8_t> m_endOfBandRunCorrectionBits; // BE - the correction bits of the blocks of the run
+        };
+    private:
+        using HuffmanCode = HuffmanEncoder::HuffmanTable::HuffmanCode;
+        ScanParameters m_scan;
+        std::array<HuffmanTableSpecification, 2> m_specifications; // Luminance, chrominance
+        std::array<std::array<HuffmanCode, 256>, 2> m_codes;
+    };
 }
 
 #endif
\ No newline at end of file
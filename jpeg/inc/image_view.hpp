@@ -0,0 +1,36 @@
+#ifndef _JPEG_IMAGE_VIEW_HPP_
+#define _JPEG_IMAGE_VIEW_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+#include "bitmap_image.hpp"
+
+namespace jpeg{
+
+    /* Layout of a single pixel in memory. Alpha channels are ignored. */
+    enum class PixelFormat : uint8_t{
+        RGB24,
+        BGR24,
+        RGBA32,
+        BGRA32
+    };
+
+    /* A non-owning view of an externally owned image, which may be encoded without first copying it into a
+       BitmapImageRGB. Rows are separated by a stride of any number of bytes (at least one row of pixels), so
+       padded rows and sub-images may be viewed in place. The viewed buffer must outlive the view. */
+    struct ImageView{
+        ImageView(uint8_t const* data, uint16_t width, uint16_t height, size_t stride, PixelFormat format);
+        ImageView(BitmapImageRGB const& image);
+        size_t static getBytesPerPixel(PixelFormat format);
+        void copyRow(uint16_t row, uint16_t firstCol, uint16_t numCols, BitmapImageRGB::PixelData* dest) const;
+        uint8_t const* m_data;
+        uint16_t m_width, m_height;
+        size_t m_stride;
+        PixelFormat m_format;
+    };
+}
+
+#endif
@@ -7,8 +7,13 @@ namespace jpeg{
     uint16_t const markerCommentSegmentCOM{0xFFFE};
     uint16_t const markerDefineQuantisationTableSegmentDQT{0xFFDB};
     uint16_t const markerStartOfFrame0SOF0{0xFFC0};
+    uint16_t const markerStartOfFrame2SOF2{0xFFC2};
+    uint16_t const markerStartOfFrame9SOF9{0xFFC9};
     uint16_t const markerDefineHuffmanTableSegmentDHT{0xFFC4};
+    uint16_t const markerDefineArithmeticConditioningSegmentDAC{0xFFCC};
     uint16_t const markerStartOfScanSegmentSOS{0xFFDA};
+    uint16_t const markerDefineRestartIntervalSegmentDRI{0xFFDD};
+    uint16_t const markerRestartIntervalRST0{0xFFD0}; // RST0 to RST7 are numbered consecutively, modulo 8
     uint16_t const markerEndOfImageSegmentEOI{0xFFD9};
 }
 #endif
\ No newline at end of file
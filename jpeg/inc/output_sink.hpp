@@ -0,0 +1,83 @@
+#ifndef _JPEG_OUTPUT_SINK_HPP_
+#define _JPEG_OUTPUT_SINK_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <span>
+#include <algorithm>
+#include <vector>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+namespace jpeg{
+
+    /* Destination for encoded bytes, which are written in order as soon as they are complete. Allows JPEGs to
+       be encoded straight into their final destination, without an intermediate in-memory copy. */
+    class OutputSink{
+    public:
+        OutputSink() = default;
+        OutputSink(OutputSink const&) = delete;
+        OutputSink(OutputSink const&&) = delete;
+        OutputSink& operator=(OutputSink const&) = delete;
+        OutputSink& operator=(OutputSink const&&) = delete;
+        virtual ~OutputSink() = default;
+    public:
+        void write(std::span<uint8_t const> bytes);
+        void flush();
+        size_t getBytesWritten() const;
+    protected:
+        virtual void writeBytes(std::span<uint8_t const> bytes) = 0;
+        virtual void flushBytes(){}
+    private:
+        size_t m_bytesWritten = 0;
+    };
+
+    /* Writes into a fixed, caller-supplied buffer. If the buffer is too small, the sink is marked as overflowed
+       and further bytes are counted but discarded, so that the required buffer size is known once encoding ends. */
+    class BufferOutputSink : public OutputSink{
+    public:
+        BufferOutputSink(std::span<uint8_t> buffer);
+        bool hasOverflowed() const;
+        size_t getRequiredSize() const;
+        std::span<uint8_t const> getOutput() const;
+    protected:
+        void writeBytes(std::span<uint8_t const> bytes) override;
+    private:
+        std::span<uint8_t> m_buffer;
+        size_t m_bufferUsed;
+        bool m_overflowed;
+    };
+
+    /* Writes to a POSIX file descriptor (e.g. a file, pipe or socket), in chunks of a fixed size. Output is only
+       guaranteed to have been written once the sink has been flushed, which the encoder does on completion. The
+       file descriptor is not closed by the sink. */
+    class FileDescriptorOutputSink : public OutputSink{
+    public:
+        FileDescriptorOutputSink(int fileDescriptor, size_t chunkSize = 1 << 16);
+    protected:
+        void writeBytes(std::span<uint8_t const> bytes) override;
+        void flushBytes() override;
+    private:
+        void writeToFileDescriptor(std::span<uint8_t const> bytes) const;
+    private:
+        int const m_fileDescriptor;
+        size_t const m_chunkSize;
+        std::vector<uint8_t> m_chunk;
+    };
+
+    /* Passes each run of encoded bytes to a callback. The bytes are only valid for the duration of the call. */
+    class CallbackOutputSink : public OutputSink{
+    public:
+        using Callback = std::function<void(std::span<uint8_t const>)>;
+        CallbackOutputSink(Callback callback);
+    protected:
+        void writeBytes(std::span<uint8_t const> bytes) override;
+    private:
+        Callback m_callback;
+    };
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define _JPEG_QUANTISER_HPP_
 
 #include <cmath>
+#include <optional>
 
 #include "discrete_cosine_transform.hpp"
 #include "bit_stream.hpp"
@@ -11,18 +12,56 @@ namespace jpeg{
 
     struct QuantisedBlockChannelData{
         std::array<int16_t, BlockGrid::blockElements> m_data;
+        /* All non-zero coefficients lie in the top-left m_nonZeroExtent x m_nonZeroExtent corner of the block.
+           Set by the entropy decoder, so that sparse blocks may be inverse transformed more cheaply. */
+        uint8_t m_nonZeroExtent = BlockGrid::blockSize;
     };
 
+    /* A quantisation matrix, in row-major (not zig-zag) order */
+    using QuantisationTable = std::array<uint16_t, BlockGrid::blockElements>;
+
+    /* Quantises blocks by multiplying by precomputed reciprocals of the divisors. SSE2 and AVX2 kernels quantise and
+       dequantise a whole block at once, and are used if supported by the CPU, unless a lower SIMD level is requested.
+       All kernels give identical results: a vector of quotients is recalculated by division if any lies within 
+       the rounding error of the reciprocal of a rounding boundary, and integral coefficients are divided exactly. */
     class Quantiser{
     public:
-        Quantiser(int quality = 50);
+        Quantiser(int quality = 50, SimdLevel simdLevel = getPreferredSimdLevel());
+        Quantiser(QuantisationTable const& luminanceMatrix, QuantisationTable const& chrominanceMatrix, SimdLevel simdLevel = getPreferredSimdLevel());
         QuantisedBlockChannelData quantise(DctBlockChannelData const& dctInput, bool useLuminanceMatrix) const;
+        QuantisedBlockChannelData quantiseToZigZag(DctBlockChannelData const& dctInput, bool useLuminanceMatrix) const;
         DctBlockChannelData dequantise(QuantisedBlockChannelData const& quantisedInput, bool useLuminanceMatrix) const;
+        std::array<float, BlockGrid::blockElements> getQuotients(DctBlockChannelData const& dctInput, bool useLuminanceMatrix) const;
+        std::array<float, BlockGrid::blockElements> getStepSizes(bool useLuminanceMatrix) const;
         void encodeHeaderQuantisationTables(BitStream& outputStream) const;
-        /* Issue: include decoding for non-default tables */
+        void static decodeHeaderQuantisationTables(BitStream const& inputStream, BitStreamReadProgress& readProgress, std::array<std::optional<QuantisationTable>, 4>& tables);
+        void applyTransformScaling(DiscreteCosineTransformer const& transformer);
+        SimdLevel getSimdLevel() const;
+    private:
+        void updateScaledMatrices();
+        QuantisedBlockChannelData quantiseCoefficients(std::array<float, BlockGrid::blockElements> const& coefficients, std::array<float, BlockGrid::blockElements> const& divisors, std::array<float, BlockGrid::blockElements> const& reciprocals) const;
+        QuantisedBlockChannelData static quantiseIntegerCoefficients(std::array<float, BlockGrid::blockElements> const& coefficients, std::array<float, BlockGrid::blockElements> const& divisors);
+#if JPEG_SIMD_X86
+        void static quantiseSSE2(float const* coefficients, float const* divisors, float const* reciprocals, int16_t* output);
+        void static quantiseIntegerCoefficientsSSE2(float const* coefficients, float const* divisors, float const* reciprocals, int16_t* output);
+        void static dequantiseSSE2(int16_t const* input, float const* multipliers, float* output);
+        void static quantiseAVX2(float const* coefficients, float const* divisors, float const* reciprocals, int16_t* output);
+        void static quantiseIntegerCoefficientsAVX2(float const* coefficients, float const* divisors, float const* reciprocals, int16_t* output);
+        void static dequantiseAVX2(int16_t const* input, float const* multipliers, float* output);
+#endif
     private:
-        std::array<uint16_t, BlockGrid::blockElements> m_luminanceQuantisationMatrix;
-        std::array<uint16_t, BlockGrid::blockElements> m_chrominanceQuantisationMatrix;
+        QuantisationTable m_luminanceQuantisationMatrix;
+        QuantisationTable m_chrominanceQuantisationMatrix;
+        // Quantisation matrices with the scale factors of the transformer folded in
+        std::array<float, BlockGrid::blockElements> m_forwardScaleFactors, m_inverseScaleFactors;
+        std::array<float, BlockGrid::blockElements> m_luminanceDivisors, m_chrominanceDivisors;
+        std::array<float, BlockGrid::blockElements> m_luminanceReciprocals, m_chrominanceReciprocals;
+        // The divisors and reciprocals in zig-zag order
+        std::array<float, BlockGrid::blockElements> m_luminanceZigZagDivisors, m_chrominanceZigZagDivisors;
+        std::array<float, BlockGrid::blockElements> m_luminanceZigZagReciprocals, m_chrominanceZigZagReciprocals;
+        std::array<float, BlockGrid::blockElements> m_luminanceMultipliers, m_chrominanceMultipliers;
+        bool m_integerCoefficients = false;
+        SimdLevel m_simdLevel;
     };
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,30 @@
+#ifndef _JPEG_SIMD_HPP_
+#define _JPEG_SIMD_HPP_
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+/* SIMD kernels are compiled for x86 with GCC-compatible compilers (via function target attributes, so no 
+   additional compiler flags are needed), and selected at runtime according to the features of the CPU */
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #define JPEG_SIMD_X86 1
+#else
+    #define JPEG_SIMD_X86 0
+#endif
+
+namespace jpeg{
+
+    /* Instruction sets for which SIMD kernels exist, in increasing order of capability */
+    enum class SimdLevel{
+        Scalar,
+        SSE2,
+        AVX2
+    };
+
+    SimdLevel getSupportedSimdLevel();
+    SimdLevel getPreferredSimdLevel();
+    char const* getSimdLevelName(SimdLevel simdLevel);
+}
+
+#endif
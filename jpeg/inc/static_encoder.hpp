@@ -0,0 +1,87 @@
+#ifndef _JPEG_STATIC_ENCODER_HPP_
+#define _JPEG_STATIC_ENCODER_HPP_
+
+#include <type_traits>
+
+#include "encoder.hpp"
+
+namespace jpeg{
+
+    /* A compile-time specialised form of the Encoder pipeline. The components are held by value and their
+       implementations are called by qualified name, so each block is encoded without any virtual dispatch and
+       the whole pipeline may be inlined (across translation units when building with link-time optimisation).
+       The output is byte-identical to an Encoder constructed with the same components. The dependency-injected
+       Encoder remains the more flexible choice, e.g. for selecting components at runtime. */
+    template <typename Mapper, typename Dct, typename Quant, typename Entropy>
+    class StaticEncoder{
+        static_assert(std::is_base_of_v<ColourMapper, Mapper>);
+        static_assert(std::is_base_of_v<DiscreteCosineTransformer, Dct>);
+        static_assert(std::is_base_of_v<Quantiser, Quant>);
+        static_assert(std::is_base_of_v<EntropyEncoder, Entropy>);
+    public:
+        StaticEncoder(int quality) : m_quantiser{quality}{
+            m_quantiser.applyTransformScaling(m_discreteCosineTransformer);
+        }
+        StaticEncoder(StaticEncoder const&) = delete;
+        StaticEncoder(StaticEncoder const&&) = delete;
+        StaticEncoder& operator=(StaticEncoder const&) = delete;
+        StaticEncoder& operator=(StaticEncoder const&&) = delete;
+        ~StaticEncoder() = default;
+        void encode(BitmapImageRGB const& inputImage, JPEGImage& outputImage) const;
+        void encode(ImageView const& inputImage, JPEGImage& outputImage) const;
+    private:
+        void encodeBlocks(InputBlockGrid const& blockGrid, BitStream& outputStream) const;
+    private:
+        Mapper m_colourMapper;
+        Dct m_discreteCosineTransformer;
+        Quant m_quantiser;
+        Entropy m_entropyEncoder;
+    };
+
+    using StaticBaselineEncoder = StaticEncoder<RGBToYCbCrMapper, SeparatedDiscreteCosineTransformer, Quantiser, HuffmanEncoder>;
+
+    template <typename Mapper, typename Dct, typename Quant, typename Entropy>
+    void StaticEncoder<Mapper, Dct, Quant, Entropy>::encode(BitmapImageRGB const& inputImage, JPEGImage& outputImage) const{
+        encode(ImageView(inputImage), outputImage);
+    }
+
+    template <typename Mapper, typename Dct, typename Quant, typename Entropy>
+    void StaticEncoder<Mapper, Dct, Quant, Entropy>::encode(ImageView const& inputImage, JPEGImage& outputImage) const{
+        try{
+            outputImage.m_compressedImageData.clearStream();
+            Encoder::encodeHeader(inputImage.m_width, inputImage.m_height, outputImage.m_compressedImageData, m_quantiser, m_entropyEncoder, 0);
+            outputImage.m_compressedImageData.setByteStuffing(true);
+            encodeBlocks(InputBlockGrid(inputImage), outputImage.m_compressedImageData);
+            outputImage.m_compressedImageData.pushIntoAlignment();
+            outputImage.m_compressedImageData.setByteStuffing(false);
+            // Push end of image marker
+            outputImage.m_compressedImageData.pushWord(markerEndOfImageSegmentEOI);
+
+            outputImage.m_width = inputImage.m_width;
+            outputImage.m_height = inputImage.m_height;
+            outputImage.m_fileSize = outputImage.m_compressedImageData.getSize();
+            // Only YCbCr-mapped images are valid JFIF files
+            outputImage.m_supportsSaving = std::is_same_v<Mapper, RGBToYCbCrMapper>;
+        }
+        catch(std::exception const& e){
+            std::cout << "[Error]: " << e.what() << "\n";
+        }
+    }
+
+    /* Equivalent to Encoder::encodeBlocks, with every stage bound statically */
+    template <typename Mapper, typename Dct, typename Quant, typename Entropy>
+    void StaticEncoder<Mapper, Dct, Quant, Entropy>::encodeBlocks(InputBlockGrid const& blockGrid, BitStream& outputStream) const{
+        std::array<int16_t, 3> lastDCValues = {0,0,0};
+        for (auto const& block : blockGrid){
+            ColourMappedBlockData const colourMappedBlock = m_colourMapper.Mapper::applyMapping(block);
+            for (uint8_t channel = 0 ; channel < 3 ; ++channel){
+                bool const isLuminance = m_colourMapper.Mapper::componentIsLuminance(channel);
+                DctBlockChannelData const dctData = m_discreteCosineTransformer.Dct::applyTransform(
+                    m_discreteCosineTransformer.applyOffset(colourMappedBlock.m_data[channel]));
+                m_entropyEncoder.Entropy::encodeZigZag(m_quantiser.Quant::quantiseToZigZag(dctData, isLuminance), lastDCValues[channel], outputStream, isLuminance);
+            }
+        }
+    }
+}
+
+#endif
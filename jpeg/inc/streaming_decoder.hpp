@@ -0,0 +1,34 @@
+#ifndef _JPEG_STREAMING_DECODER_HPP_
+#define _JPEG_STREAMING_DECODER_HPP_
+
+#include <cstdint>
+#include <array>
+#include <functional>
+
+#include "encoder.hpp"
+
+namespace jpeg{
+
+    /* Decodes a JPEG one block-row at a time using the pipeline of an existing Encoder, passing each band of (up to)
+       eight decoded rows to the sink as soon as it is complete. The compressed data is read in place (as it is by
+       Encoder::decode), and only a single band of pixels is held in memory. Memory use is therefore proportional
+       to the width of the image, rather than its area. */
+    class StreamingDecoder{
+    public:
+        using OutputSink = std::function<void(uint16_t firstRow, BitmapImageRGB const& band)>;
+        StreamingDecoder(Encoder const& encoder, OutputSink sink);
+        StreamingDecoder(StreamingDecoder const&) = delete;
+        StreamingDecoder(StreamingDecoder const&&) = delete;
+        StreamingDecoder& operator=(StreamingDecoder const&) = delete;
+        StreamingDecoder& operator=(StreamingDecoder const&&) = delete;
+        ~StreamingDecoder() = default;
+        void decode(JPEGImage const& inputImage);
+    private:
+        uint16_t readAlignedMarker(BitStream const& inputStream, BitReader& inputReader) const;
+    private:
+        Encoder const& m_encoder;
+        OutputSink m_sink;
+    };
+}
+
+#endif
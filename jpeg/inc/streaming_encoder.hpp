@@ -0,0 +1,40 @@
+#ifndef _JPEG_STREAMING_ENCODER_HPP_
+#define _JPEG_STREAMING_ENCODER_HPP_
+
+#include <cstdint>
+#include <array>
+#include <span>
+
+#include "encoder.hpp"
+
+namespace jpeg{
+
+    /* Encodes an image which is supplied incrementally, row by row, using the pipeline of an existing Encoder.
+       Each band of eight rows (i.e. one block-row) is colour-mapped, transformed, quantised and entropy-coded as 
+       soon as it is complete, and the finished bytes are written straight to the sink (which is flushed once the
+       last row has been encoded). Memory use is therefore proportional to the width of the image, rather than its area. */
+    class StreamingEncoder{
+    public:
+        StreamingEncoder(Encoder const& encoder, uint16_t width, uint16_t height, OutputSink& sink);
+        StreamingEncoder(StreamingEncoder const&) = delete;
+        StreamingEncoder(StreamingEncoder const&&) = delete;
+        StreamingEncoder& operator=(StreamingEncoder const&) = delete;
+        StreamingEncoder& operator=(StreamingEncoder const&&) = delete;
+        ~StreamingEncoder() = default;
+        void pushRows(std::span<BitmapImageRGB::PixelData const> rows);
+        bool isComplete() const;
+    private:
+        void encodeBand();
+    private:
+        Encoder const& m_encoder;
+        uint16_t const m_width, m_height;
+        uint16_t m_rowsEncoded;
+        BitmapImageRGB m_band;
+        uint16_t m_rowsInBand;
+        std::array<int16_t, 3> m_lastDCValues;
+        BitStream m_outputStream;
+        OutputSink& m_sink;
+    };
+}
+
+#endif
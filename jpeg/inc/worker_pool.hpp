@@ -0,0 +1,45 @@
+#ifndef _JPEG_WORKER_POOL_HPP_
+#define _JPEG_WORKER_POOL_HPP_
+
+#include <cstddef>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+namespace jpeg{
+
+    /* A fixed-size pool of worker threads. Each call to run() distributes a number of independent tasks
+       between the workers and blocks until all of them have completed. The calling thread acts as worker 0,
+       so a pool with a single worker never spawns a thread (as required for non-threaded Emscripten builds). */
+    class WorkerPool{
+    public:
+        using Task = std::function<void(size_t taskIndex, size_t workerIndex)>;
+        WorkerPool(unsigned int numWorkers = 1);
+        WorkerPool(WorkerPool const&) = delete;
+        WorkerPool(WorkerPool const&&) = delete;
+        WorkerPool& operator=(WorkerPool const&) = delete;
+        WorkerPool& operator=(WorkerPool const&&) = delete;
+        ~WorkerPool();
+        size_t getNumWorkers() const;
+        void run(size_t numTasks, Task const& task);
+    private:
+        void workerLoop(size_t workerIndex);
+        void processTasks(size_t workerIndex);
+    private:
+        std::vector<std::thread> m_threads;
+        std::mutex m_mutex;
+        std::condition_variable m_workAvailable;
+        std::condition_variable m_workComplete;
+        Task const* m_task;
+        size_t m_numTasks, m_nextTask;
+        size_t m_busyWorkers;
+        size_t m_generation;
+        bool m_stopping;
+        std::exception_ptr m_exception;
+    };
+}
+
+#endif
@@ -0,0 +1,433 @@
+#include "entropy_encoder.hpp"
+
+namespace{
+    /* A row of Table D.2 of ITU-T81: the estimated probability of the less probable symbol (scaled so that 0x10000
+       represents 1), the rows to move to after coding each symbol, and whether coding the less probable symbol
+       exchanges the senses of the symbols */
+    struct ProbabilityEstimate{
+        uint16_t m_qe;
+        uint8_t m_nextIndexLPS;
+        uint8_t m_nextIndexMPS;
+        bool m_switchMPS;
+    };
+
+    /* The final row is not part of Table D.2: it holds a fixed estimate of 1/2, as used by libjpeg for AC signs */
+    constexpr std::array<ProbabilityEstimate, 114> probabilityEstimates{{
+        {0x5A1D,   1,   1, true},  {0x2586,  14,   2, false}, {0x1114,  16,   3, false}, {0x080B,  18,   4, false},
+        {0x03D8,  20,   5, false}, {0x01DA,  23,   6, false}, {0x00E5,  25,   7, false}, {0x006F,  28,   8, false},
+        {0x0036,  30,   9, false}, {0x001A,  33,  10, false}, {0x000D,  35,  11, false}, {0x0006,   9,  12, false},
+        {0x0003,  10,  13, false}, {0x0001,  12,  13, false}, {0x5A7F,  15,  15, true},  {0x3F25,  36,  16, false},
+        {0x2CF2,  38,  17, false}, {0x207C,  39,  18, false}, {0x17B9,  40,  19, false}, {0x1182,  42,  20, false},
+        {0x0CEF,  43,  21, false}, {0x09A1,  45,  22, false}, {0x072F,  46,  23, false}, {0x055C,  48,  24, false},
+        {0x0406,  49,  25, false}, {0x0303,  51,  26, false}, {0x0240,  52,  27, false}, {0x01B1,  54,  28, false},
+        {0x0144,  56,  29, false}, {0x00F5,  57,  30, false}, {0x00B7,  59,  31, false}, {0x008A,  60,  32, false},
+        {0x0068,  62,  33, false}, {0x004E,  63,  34, false}, {0x003B,  32,  35, false}, {0x002C,  33,   9, false},
+        {0x5AE1,  37,  37, true},  {0x484C,  64,  38, false}, {0x3A0D,  65,  39, false}, {0x2EF1,  67,  40, false},
+        {0x261F,  68,  41, false}, {0x1F33,  69,  42, false}, {0x19A8,  70,  43, false}, {0x1518,  72,  44, false},
+        {0x1177,  73,  45, false}, {0x0E74,  74,  46, false}, {0x0BFB,  75,  47, false}, {0x09F8,  77,  48, false},
+        {0x0861,  78,  49, false}, {0x0706,  79,  50, false}, {0x05CD,  48,  51, false}, {0x04DE,  50,  52, false},
+        {0x040F,  50,  53, false}, {0x0363,  51,  54, false}, {0x02D4,  52,  55, false}, {0x025C,  53,  56, false},
+        {0x01F8,  54,  57, false}, {0x01A4,  55,  58, false}, {0x0160,  56,  59, false}, {0x0125,  57,  60, false},
+        {0x00F6,  58,  61, false}, {0x00CB,  59,  62, false}, {0x00AB,  61,  63, false}, {0x008F,  61,  32, false},
+        {0x5B12,  65,  65, true},  {0x4D04,  80,  66, false}, {0x412C,  81,  67, false}, {0x37D8,  82,  68, false},
+        {0x2FE8,  83,  69, false}, {0x293C,  84,  70, false}, {0x2379,  86,  71, false}, {0x1EDF,  87,  72, false},
+        {0x1AA9,  87,  73, false}, {0x174E,  72,  74, false}, {0x1424,  72,  75, false}, {0x119C,  74,  76, false},
+        {0x0F6B,  74,  77, false}, {0x0D51,  75,  78, false}, {0x0BB6,  77,  79, false}, {0x0A40,  77,  48, false},
+        {0x5832,  80,  81, true},  {0x4D1C,  88,  82, false}, {0x438E,  89,  83, false}, {0x3BDD,  90,  84, false},
+        {0x34EE,  91,  85, false}, {0x2EAE,  92,  86, false}, {0x299A,  93,  87, false}, {0x2516,  86,  71, false},
+        {0x5570,  88,  89, true},  {0x4CA9,  95,  90, false}, {0x44D9,  96,  91, false}, {0x3E22,  97,  92, false},
+        {0x3824,  99,  93, false}, {0x32B4,  99,  94, false}, {0x2E17,  93,  86, false}, {0x56A8,  95,  96, true},
+        {0x4F46, 101,  97, false}, {0x47E5, 102,  98, false}, {0x41CF, 103,  99, false}, {0x3C3D, 104, 100, false},
+        {0x375E,  99,  93, false}, {0x5231, 105, 102, false}, {0x4C0F, 106, 103, false}, {0x4639, 107, 104, false},
+        {0x415E, 103,  99, false}, {0x5627, 105, 106, true},  {0x50E7, 108, 107, false}, {0x4B85, 109, 103, false},
+        {0x5597, 110, 109, false}, {0x504F, 111, 107, false}, {0x5A10, 110, 111, true},  {0x5522, 112, 109, false},
+        {0x59EB, 112, 111, true},  {0x5A1D, 113, 113, false}
+    }};
+
+    /* The first statistics of the magnitude categories and bit patterns of DC differences (X1 in Table F.4), and of
+       AC coefficients up to and beyond the conditioning threshold Kx (Table F.5) */
+    size_t const dcMagnitudeStatistics = 20;
+    size_t const lowACMagnitudeStatistics = 189;
+    size_t const highACMagnitudeStatistics = 217;
+    // The statistics of each bit pattern follow those of the magnitude categories
+    size_t const magnitudeBitStatisticsOffset = 14;
+
+    /* The statistic of the probability estimate after coding a symbol */
+    uint8_t getNextStatistic(uint8_t statistic, bool codedMPS){
+        ProbabilityEstimate const& estimate = probabilityEstimates[statistic & 0x7F];
+        if (codedMPS){
+            return (statistic & 0x80) | estimate.m_nextIndexMPS;
+        }
+        return ((statistic & 0x80) ^ (estimate.m_switchMPS ? 0x80 : 0x00)) | estimate.m_nextIndexLPS;
+    }
+}
+
+jpeg::ArithmeticEncoder::ArithmeticEncoder(ArithmeticConditioning const& luminanceConditioning, ArithmeticConditioning const& chrominanceConditioning) :
+                                           m_conditioning{luminanceConditioning, chrominanceConditioning}{
+    for (ArithmeticConditioning const& conditioning : m_conditioning){
+        if (conditioning.m_dcLowerBound > conditioning.m_dcUpperBound || conditioning.m_dcUpperBound > 15){
+            throw std::runtime_error("Arithmetic conditioning requires DC bounds with L <= U <= 15");
+        }
+        if (conditioning.m_acThreshold < 1 || conditioning.m_acThreshold > 63){
+            throw std::runtime_error("Arithmetic conditioning requires an AC threshold between 1 and 63");
+        }
+    }
+}
+
+void jpeg::ArithmeticEncoder::encodeHeaderEntropyTables(BitStream& outputStream) const{
+    outputStream.pushWord(markerDefineArithmeticConditioningSegmentDAC);
+    outputStream.pushWord(2 + 2 * 4); // length
+    for (uint8_t tableID = 0 ; tableID < m_conditioning.size() ; ++tableID){
+        outputStream.pushByte(0x00 | tableID); // DC table + ID
+        outputStream.pushByte(m_conditioning[tableID].m_dcLowerBound | (m_conditioning[tableID].m_dcUpperBound << 4));
+        outputStream.pushByte(0x10 | tableID); // AC table + ID
+        outputStream.pushByte(m_conditioning[tableID].m_acThreshold);
+    }
+}
+
+uint16_t jpeg::ArithmeticEncoder::getStartOfFrameMarker() const{
+    return markerStartOfFrame9SOF9;
+}
+
+/* Reads the conditioning values of a DAC segment (following its marker), storing each at index 4 * class + ID, where
+   the class is 0 for DC tables (holding L | U << 4) and 1 for AC tables (holding Kx) */
+void jpeg::ArithmeticEncoder::decodeHeaderEntropyTables(BitStream const& inputStream, BitStreamReadProgress& readProgress, std::array<uint8_t, 8>& conditioningValues){
+    auto const startOfDACPayload = readProgress.currentByte;
+    auto const DAClength = inputStream.readNextAlignedWord(readProgress);
+    if (startOfDACPayload + DAClength > inputStream.getSize() || DAClength % 2 != 0){
+        throw std::runtime_error("DAC length parameter does not correspond to payload size");
+    }
+    while (readProgress.currentByte < startOfDACPayload + DAClength){
+        uint8_t const tableClassAndID = inputStream.readNextAlignedByte(readProgress);
+        uint8_t const value = inputStream.readNextAlignedByte(readProgress);
+        if ((tableClassAndID >> 4) > 1 || (tableClassAndID & 0xF) > 3){
+            throw std::runtime_error("Invalid conditioning table class or ID in DAC payload");
+        }
+        if ((tableClassAndID >> 4) == 0 ? (value & 0xF) > (value >> 4) : (value < 1 || value > 63)){
+            throw std::runtime_error("Invalid conditioning value in DAC payload");
+        }
+        conditioningValues[4 * (tableClassAndID >> 4) + (tableClassAndID & 0xF)] = value;
+    }
+}
+
+jpeg::ArithmeticEncoder::IntervalEncoder::IntervalEncoder(ArithmeticEncoder const& arithmeticEncoder, BitStream& outputStream) :
+                                                          m_arithmeticEncoder{arithmeticEncoder}, m_outputStream{outputStream},
+                                                          m_codeRegister{0}, m_intervalRegister{0x10000}, m_bitsUntilByte{11},
+                                                          m_bufferedByte{-1}, m_stackedFFBytes{0}, m_pendingZeroBytes{0}{
+}
+
+/* Encodes the DC difference and AC coefficients of a block with the models of Sections F.1.4.1 and F.1.4.2. Each
+   non-zero value is coded as a sign, a magnitude category (in unary) and the bits of its magnitude below the leading
+   one, with statistics conditioned on the previous DC difference (for DC) or the zig-zag index (for AC). */
+void jpeg::ArithmeticEncoder::IntervalEncoder::encode(QuantisedBlockChannelData const& input, size_t component, bool isLuminanceComponent){
+    ArithmeticConditioning const& conditioning = m_arithmeticEncoder.m_conditioning[!isLuminanceComponent];
+    auto& dcStatistics = m_modelState.m_dcStatistics[!isLuminanceComponent];
+    auto& acStatistics = m_modelState.m_acStatistics[!isLuminanceComponent];
+
+    // DC difference
+    int difference = input.m_data[0] - m_modelState.m_lastDCValues[component];
+    m_modelState.m_lastDCValues[component] = input.m_data[0];
+    size_t statistic = m_modelState.m_dcContexts[component];
+    if (difference == 0){
+        encodeDecision(dcStatistics[statistic], false);
+        m_modelState.m_dcContexts[component] = 0;
+    }
+    else{
+        encodeDecision(dcStatistics[statistic], true);
+        encodeDecision(dcStatistics[statistic + 1], difference < 0);
+        statistic += difference > 0 ? 2 : 3;
+        m_modelState.m_dcContexts[component] = difference > 0 ? 4 : 8;
+        int const magnitude = (difference > 0 ? difference : -difference) - 1;
+        int categoryBit = 0;
+        if (magnitude != 0){
+            encodeDecision(dcStatistics[statistic], true);
+            categoryBit = 1;
+            statistic = dcMagnitudeStatistics;
+            for (int remaining = magnitude >> 1 ; remaining != 0 ; remaining >>= 1){
+                encodeDecision(dcStatistics[statistic++], true);
+                categoryBit <<= 1;
+            }
+        }
+        encodeDecision(dcStatistics[statistic], false);
+        // Condition the next difference on whether this one was small or large (Section F.1.4.4.1.2)
+        if (categoryBit < ((1 << conditioning.m_dcLowerBound) >> 1)){
+            m_modelState.m_dcContexts[component] = 0;
+        }
+        else if (categoryBit > ((1 << conditioning.m_dcUpperBound) >> 1)){
+            m_modelState.m_dcContexts[component] += 8;
+        }
+        statistic += magnitudeBitStatisticsOffset;
+        for (categoryBit >>= 1 ; categoryBit != 0 ; categoryBit >>= 1){
+            encodeDecision(dcStatistics[statistic], (magnitude & categoryBit) != 0);
+        }
+    }
+
+    // AC coefficients, up to the last non-zero one in zig-zag order
+    size_t lastNonZeroIndex = BlockGrid::blockElements - 1;
+    while (lastNonZeroIndex > 0 && input.m_data[zigZagIndices[lastNonZeroIndex]] == 0){
+        --lastNonZeroIndex;
+    }
+    size_t index = 1;
+    for ( ; index <= lastNonZeroIndex ; ++index){
+        statistic = 3 * (index - 1);
+        encodeDecision(acStatistics[statistic], false); // Not the end of the block
+        int value;
+        while ((value = input.m_data[zigZagIndices[index]]) == 0){
+            encodeDecision(acStatistics[statistic + 1], false);
+            statistic += 3;
+            ++index;
+        }
+        encodeDecision(acStatistics[statistic + 1], true);
+        encodeDecision(m_modelState.m_fixedStatistic, value < 0);
+        statistic += 2;
+        int const magnitude = (value > 0 ? value : -value) - 1;
+        int categoryBit = 0;
+        if (magnitude != 0){
+            encodeDecision(acStatistics[statistic], true);
+            categoryBit = 1;
+            int remaining = magnitude >> 1;
+            if (remaining != 0){
+                encodeDecision(acStatistics[statistic], true);
+                categoryBit <<= 1;
+                statistic = index <= conditioning.m_acThreshold ? lowACMagnitudeStatistics : highACMagnitudeStatistics;
+                for (remaining >>= 1 ; remaining != 0 ; remaining >>= 1){
+                    encodeDecision(acStatistics[statistic++], true);
+                    categoryBit <<= 1;
+                }
+            }
+        }
+        encodeDecision(acStatistics[statistic], false);
+        statistic += magnitudeBitStatisticsOffset;
+        for (categoryBit >>= 1 ; categoryBit != 0 ; categoryBit >>= 1){
+            encodeDecision(acStatistics[statistic], (magnitude & categoryBit) != 0);
+        }
+    }
+    if (index < BlockGrid::blockElements){
+        encodeDecision(acStatistics[3 * (index - 1)], true); // End of the block
+    }
+}
+
+/* Codes a binary decision with the given statistic, as in Section D.1 (with the register and byte-output conventions
+   of libjpeg, which differ from the flowcharts only in where the binary point of C lies) */
+void jpeg::ArithmeticEncoder::IntervalEncoder::encodeDecision(uint8_t& statistic, bool decision){
+    uint32_t const qe = probabilityEstimates[statistic & 0x7F].m_qe;
+    m_intervalRegister -= qe;
+    if (decision != bool(statistic >> 7)){
+        // The less probable symbol takes the smaller of the two subintervals (conditional exchange)
+        if (m_intervalRegister >= qe){
+            m_codeRegister += m_intervalRegister;
+            m_intervalRegister = qe;
+        }
+        statistic = getNextStatistic(statistic, false);
+    }
+    else{
+        if (m_intervalRegister >= 0x8000){
+            return;
+        }
+        if (m_intervalRegister < qe){
+            m_codeRegister += m_intervalRegister;
+            m_intervalRegister = qe;
+        }
+        statistic = getNextStatistic(statistic, true);
+    }
+
+    // Renormalise, outputting a byte of the code register whenever 8 bits have been shifted into its top
+    do{
+        m_intervalRegister <<= 1;
+        m_codeRegister <<= 1;
+        if (--m_bitsUntilByte == 0){
+            uint32_t const byte = m_codeRegister >> 19;
+            if (byte == 0xFF){
+                // The byte is not final until it is known whether a carry will reach it
+                ++m_stackedFFBytes;
+            }
+            else{
+                pushBufferedBytes(byte > 0xFF);
+                m_bufferedByte = byte & 0xFF;
+            }
+            m_codeRegister &= 0x7FFFF;
+            m_bitsUntilByte += 8;
+        }
+    } while (m_intervalRegister < 0x8000);
+}
+
+/* Terminates the interval (Section D.1.8), choosing the final value of the code register in the current interval
+   with as many trailing zero bits as possible. Trailing zero bytes are omitted, since the decoder reads zeros from
+   the following marker onwards. */
+void jpeg::ArithmeticEncoder::IntervalEncoder::finish(){
+    uint32_t const roundedCode = (m_intervalRegister - 1 + m_codeRegister) & 0xFFFF0000;
+    m_codeRegister = roundedCode < m_codeRegister ? roundedCode + 0x8000 : roundedCode;
+    m_codeRegister <<= m_bitsUntilByte;
+    pushBufferedBytes(m_codeRegister & 0xF8000000);
+    if (m_codeRegister & 0x7FFF800){
+        pushPendingZeroBytes();
+        m_outputStream.pushByte(uint8_t(m_codeRegister >> 19));
+        if (m_codeRegister & 0x7F800){
+            m_outputStream.pushByte(uint8_t(m_codeRegister >> 11));
+        }
+    }
+}
+
+/* Writes the buffered byte and the 0xFF bytes stacked after it, once no carry can reach them (or once a carry has
+   incremented the buffered byte and turned the stacked bytes into 0x00). Zero bytes are withheld until a non-zero
+   byte follows them. The stream is byte-stuffed, so each 0xFF byte written is followed by a 0x00 byte. */
+void jpeg::ArithmeticEncoder::IntervalEncoder::pushBufferedBytes(bool carry){
+    if (carry){
+        if (m_bufferedByte >= 0){
+            pushPendingZeroBytes();
+            m_outputStream.pushByte(uint8_t(m_bufferedByte + 1));
+        }
+        m_pendingZeroBytes += m_stackedFFBytes;
+        m_stackedFFBytes = 0;
+        return;
+    }
+    if (m_bufferedByte == 0){
+        ++m_pendingZeroBytes;
+    }
+    else if (m_bufferedByte > 0){
+        pushPendingZeroBytes();
+        m_outputStream.pushByte(uint8_t(m_bufferedByte));
+    }
+    if (m_stackedFFBytes > 0){
+        pushPendingZeroBytes();
+        for ( ; m_stackedFFBytes > 0 ; --m_stackedFFBytes){
+            m_outputStream.pushByte(0xFF);
+        }
+    }
+}
+
+void jpeg::ArithmeticEncoder::IntervalEncoder::pushPendingZeroBytes(){
+    for ( ; m_pendingZeroBytes > 0 ; --m_pendingZeroBytes){
+        m_outputStream.pushByte(0x00);
+    }
+}
+
+/* The decoder starts with an empty interval, so that the first decision loads two bytes into the code register */
+jpeg::ArithmeticEncoder::IntervalDecoder::IntervalDecoder(ArithmeticEncoder const& arithmeticEncoder, BitReader& inputReader) :
+                                                          m_arithmeticEncoder{arithmeticEncoder}, m_inputReader{inputReader},
+                                                          m_codeRegister{0}, m_intervalRegister{0}, m_bitsInCodeRegister{-16}{
+}
+
+/* Decodes a block (in grid order) with the models of Sections F.2.4.1 and F.2.4.2 */
+jpeg::QuantisedBlockChannelData jpeg::ArithmeticEncoder::IntervalDecoder::decode(size_t component, bool isLuminanceComponent){
+    ArithmeticConditioning const& conditioning = m_arithmeticEncoder.m_conditioning[!isLuminanceComponent];
+    auto& dcStatistics = m_modelState.m_dcStatistics[!isLuminanceComponent];
+    auto& acStatistics = m_modelState.m_acStatistics[!isLuminanceComponent];
+    QuantisedBlockChannelData output;
+    output.m_data.fill(0);
+
+    // DC difference
+    size_t statistic = m_modelState.m_dcContexts[component];
+    if (!decodeDecision(dcStatistics[statistic])){
+        m_modelState.m_dcContexts[component] = 0;
+    }
+    else{
+        bool const isNegative = decodeDecision(dcStatistics[statistic + 1]);
+        statistic += isNegative ? 3 : 2;
+        int categoryBit = decodeDecision(dcStatistics[statistic]);
+        if (categoryBit != 0){
+            statistic = dcMagnitudeStatistics;
+            while (decodeDecision(dcStatistics[statistic])){
+                if ((categoryBit <<= 1) == 0x8000){
+                    throw std::runtime_error("Arithmetic-coded DC difference exceeds 15 bits");
+                }
+                ++statistic;
+            }
+        }
+        if (categoryBit < ((1 << conditioning.m_dcLowerBound) >> 1)){
+            m_modelState.m_dcContexts[component] = 0;
+        }
+        else if (categoryBit > ((1 << conditioning.m_dcUpperBound) >> 1)){
+            m_modelState.m_dcContexts[component] = isNegative ? 16 : 12;
+        }
+        else{
+            m_modelState.m_dcContexts[component] = isNegative ? 8 : 4;
+        }
+        int magnitude = categoryBit;
+        statistic += magnitudeBitStatisticsOffset;
+        for (categoryBit >>= 1 ; categoryBit != 0 ; categoryBit >>= 1){
+            if (decodeDecision(dcStatistics[statistic])){
+                magnitude |= categoryBit;
+            }
+        }
+        int const difference = isNegative ? -(magnitude + 1) : magnitude + 1;
+        m_modelState.m_lastDCValues[component] = int16_t(m_modelState.m_lastDCValues[component] + difference);
+    }
+    output.m_data[0] = m_modelState.m_lastDCValues[component];
+
+    // AC coefficients, until the end of the block
+    size_t lastNonZeroIndex = 0;
+    for (size_t index = 1 ; index < BlockGrid::blockElements ; ++index){
+        statistic = 3 * (index - 1);
+        if (decodeDecision(acStatistics[statistic])){
+            break;
+        }
+        while (!decodeDecision(acStatistics[statistic + 1])){
+            statistic += 3;
+            if (++index == BlockGrid::blockElements){
+                throw std::runtime_error("Arithmetic-coded AC coefficients exceed block size");
+            }
+        }
+        bool const isNegative = decodeDecision(m_modelState.m_fixedStatistic);
+        statistic += 2;
+        int categoryBit = decodeDecision(acStatistics[statistic]);
+        if (categoryBit != 0 && decodeDecision(acStatistics[statistic])){
+            categoryBit <<= 1;
+            statistic = index <= conditioning.m_acThreshold ? lowACMagnitudeStatistics : highACMagnitudeStatistics;
+            while (decodeDecision(acStatistics[statistic])){
+                if ((categoryBit <<= 1) == 0x8000){
+                    throw std::runtime_error("Arithmetic-coded AC coefficient exceeds 15 bits");
+                }
+                ++statistic;
+            }
+        }
+        int magnitude = categoryBit;
+        statistic += magnitudeBitStatisticsOffset;
+        for (categoryBit >>= 1 ; categoryBit != 0 ; categoryBit >>= 1){
+            if (decodeDecision(acStatistics[statistic])){
+                magnitude |= categoryBit;
+            }
+        }
+        output.m_data[zigZagIndices[index]] = int16_t(isNegative ? -(magnitude + 1) : magnitude + 1);
+        lastNonZeroIndex = index;
+    }
+    output.m_nonZeroExtent = EntropyEncoder::getNonZeroExtent(lastNonZeroIndex);
+    return output;
+}
+
+/* Decodes a binary decision with the given statistic, as in Section D.2. Bytes are loaded into the code register
+   as the interval is renormalised, and the reader supplies zero bytes once the entropy-coded data ends. */
+bool jpeg::ArithmeticEncoder::IntervalDecoder::decodeDecision(uint8_t& statistic){
+    while (m_intervalRegister < 0x8000){
+        if (--m_bitsInCodeRegister < 0){
+            uint32_t const byte = m_inputReader.peekBits(8);
+            m_inputReader.skipBits(8);
+            m_codeRegister = (m_codeRegister << 8) | byte;
+            m_bitsInCodeRegister += 8;
+            // The first two bytes of the interval are loaded before its interval register is initialised
+            if (m_bitsInCodeRegister < 0 && ++m_bitsInCodeRegister == 0){
+                m_intervalRegister = 0x8000;
+            }
+        }
+        m_intervalRegister <<= 1;
+    }
+
+    uint32_t const qe = probabilityEstimates[statistic & 0x7F].m_qe;
+    bool decision = statistic >> 7;
+    m_intervalRegister -= qe;
+    uint32_t const scaledInterval = m_intervalRegister << m_bitsInCodeRegister;
+    if (m_codeRegister >= scaledInterval){
+        // The code lies in the upper subinterval, of size Qe
+        m_codeRegister -= scaledInterval;
+        bool const codedMPS = m_intervalRegister < qe;
+        m_intervalRegister = qe;
+        statistic = getNextStatistic(statistic, codedMPS);
+        decision ^= !codedMPS;
+    }
+    else if (m_intervalRegister < 0x8000){
+        bool const codedMPS = m_intervalRegister >= qe;
+        statistic = getNextStatistic(statistic, codedMPS);
+        decision ^= !codedMPS;
+    }
+    return decision;
+}
@@ -0,0 +1,37 @@
+#include "batch_encoder.hpp"
+
+jpeg::BatchEncoder::BatchEncoder(unsigned int numThreads) : m_workerPool{numThreads}, m_workerEncoders(m_workerPool.getNumWorkers()){
+}
+
+std::vector<jpeg::JPEGImage> jpeg::BatchEncoder::encode(std::span<BitmapImageRGB const> inputImages, std::span<int const> qualities){
+    std::vector<JPEGImage> outputImages(inputImages.size());
+    try{
+        if (qualities.size() != inputImages.size()){
+            throw std::runtime_error("Number of quality values does not correspond to number of images in batch");
+        }
+        m_workerPool.run(inputImages.size(), [&](size_t image, size_t worker){
+            getEncoder(worker, qualities[image]).encode(inputImages[image], outputImages[image]);
+        });
+    }
+    catch(std::exception const& e){
+        std::cout << "[Error]: " << e.what() << "\n";
+    }
+    return outputImages;
+}
+
+std::vector<jpeg::JPEGImage> jpeg::BatchEncoder::encode(std::span<BitmapImageRGB const> inputImages, int quality){
+    std::vector<int> const qualities(inputImages.size(), quality);
+    return encode(inputImages, qualities);
+}
+
+/* Returns the given worker's encoder for a quality value, creating it on first use. Only ever called from
+   the worker in question, so no synchronisation is required. */
+jpeg::BaselineEncoder& jpeg::BatchEncoder::getEncoder(size_t worker, int quality){
+    quality = std::clamp(quality, 1, 100);
+    auto& encoders = m_workerEncoders[worker];
+    auto encoder = encoders.find(quality);
+    if (encoder == encoders.end()){
+        encoder = encoders.emplace(quality, std::make_unique<BaselineEncoder>(quality)).first;
+    }
+    return *encoder->second;
+}
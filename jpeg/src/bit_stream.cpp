@@ -17,10 +17,6 @@ void jpeg::BitStreamReadProgress::advanceBits(size_t numBits){
     }
 }
 
-void jpeg::BitStreamReadProgress::advanceBit(){
-    advanceBits(1);
-}
-
 void jpeg::BitStreamReadProgress::advanceIntoAlignment(){
     if (currentBit > 0){
         currentBit = 0;
@@ -32,57 +28,45 @@ jpeg::BitStream::BitStream(){
     clearStream();
 }
 void jpeg::BitStream::clearStream(){
-    m_buffer = 0;
-    m_bitsInBuffer = 0;
+    m_accumulator = 0;
+    m_bitsInAccumulator = 0;
+    m_byteStuffing = false;
     m_stream.clear();
 }
 
-size_t jpeg::BitStream::getSize(){
-    return m_stream.size() + (m_bitsInBuffer > 0);
+/* Reserves space for the given number of bytes, so that they may be written without reallocating */
+void jpeg::BitStream::reserve(size_t numBytes){
+    m_stream.reserve(numBytes);
+}
+
+size_t jpeg::BitStream::getSize() const{
+    return m_stream.size() + (m_bitsInAccumulator > 0);
 }
 
 void jpeg::BitStream::pushBitsu8(uint8_t data, size_t numberOfBitsToPush){
     assert(numberOfBitsToPush <= 8);
-    // Remove unneeded leading bits
-    data &= uint8_t(0xFF) >> (8 - numberOfBitsToPush);
-    int offset = 8 - m_bitsInBuffer - numberOfBitsToPush;
-    if (offset >= 0){
-        // Bits fit in buffer
-        m_buffer |= uint8_t((data) << offset);
-        m_bitsInBuffer += numberOfBitsToPush;
-        if (offset == 0){
-            // Push buffer to stream
-            m_stream.push_back(m_buffer);
-            m_buffer = 0;
-            m_bitsInBuffer = 0;
-        }
-    }
-    else{
-        // Bits do not fit in buffer
-        m_buffer |= uint8_t(data >> -offset);
-        m_stream.push_back(m_buffer);
-        m_buffer = uint8_t(data << (8 + offset));
-        m_bitsInBuffer = -offset;
-    }
+    pushBitsu16(data, numberOfBitsToPush);
 }
 
 void jpeg::BitStream::pushBitsu16(uint16_t data, size_t numberOfBitsToPush){
     assert(numberOfBitsToPush <= 16);
-    if (numberOfBitsToPush <= 8){
-        uint8_t const u8Data = data & uint8_t(0x00FF);
-        pushBitsu8(u8Data, numberOfBitsToPush);
-    }
-    else{
-        uint8_t const u8LeftData = (data >> 8) & uint8_t(0x00FF);
-        pushBitsu8(u8LeftData, numberOfBitsToPush - 8);
-        uint8_t const u8RightData = data & uint8_t(0x00FF);
-        pushBitsu8(u8RightData, 8);
+    // Only the low numberOfBitsToPush bits of the data are shifted into the accumulator
+    m_accumulator = (m_accumulator << numberOfBitsToPush) | (data & ((1u << numberOfBitsToPush) - 1));
+    m_bitsInAccumulator += numberOfBitsToPush;
+    while (m_bitsInAccumulator >= 8){
+        m_bitsInAccumulator -= 8;
+        uint8_t const byte = uint8_t(m_accumulator >> m_bitsInAccumulator);
+        m_stream.push_back(byte);
+        if (m_byteStuffing && byte == 0xFF){
+            m_stream.push_back(0x00);
+        }
     }
 }
 
 uint8_t jpeg::BitStream::readByte(size_t byte) const{
     if (byte == m_stream.size()){
-        return m_buffer;
+        // The partially filled byte, padded with 0 bits
+        return uint8_t(m_accumulator << (8 - m_bitsInAccumulator));
     }
     else{
         return m_stream[byte];
@@ -99,16 +83,28 @@ void jpeg::BitStream::pushWord(uint16_t data){
 }
 
 void jpeg::BitStream::pushIntoAlignment(){
-    if (m_bitsInBuffer > 0){
-        pushBitsu8(0, 8 - m_bitsInBuffer);
+    if (m_bitsInAccumulator > 0){
+        pushBitsu8(0, 8 - m_bitsInAccumulator);
     }
 }
 
-bool jpeg::BitStream::readNextBit(BitStreamReadProgress& progress) const{
-    uint8_t currentByte = readByte(progress.currentByte);
-    bool output = currentByte & (1u << (7 - progress.currentBit));
-    progress.advanceBit();
-    return output;
+/* Enables or disables stuffing of the bytes subsequently written to the stream */
+void jpeg::BitStream::setByteStuffing(bool byteStuffing){
+    m_byteStuffing = byteStuffing;
+}
+
+/* Appends the contents of another (byte-aligned) stream to this (byte-aligned) stream */
+void jpeg::BitStream::append(BitStream const& other){
+    assert(m_bitsInAccumulator == 0 && other.m_bitsInAccumulator == 0);
+    m_stream.insert(m_stream.end(), other.m_stream.begin(), other.m_stream.end());
+}
+
+/* Passes the complete bytes in the stream to a sink, then discards them. Any partially filled byte remains in the buffer. */
+void jpeg::BitStream::flushCompleteBytes(OutputSink& sink){
+    if (!m_stream.empty()){
+        sink.write(m_stream);
+        m_stream.clear();
+    }
 }
 
 uint8_t jpeg::BitStream::readNextAlignedByte(BitStreamReadProgress& progress) const{
@@ -124,24 +120,113 @@ uint8_t const* jpeg::BitStream::getDataPtr() const{
     return m_stream.data();
 }
 
-void jpeg::BitStream::stuffBytes(size_t from){
-    for (auto byte = m_stream.begin() + from ; byte != m_stream.end() ; ++byte){
-        if (*byte == 0xFF){
-            ++byte;
-            m_stream.insert(byte, 0x00);
+std::span<uint8_t const> jpeg::BitStream::getBytes() const{
+    return m_stream;
+}
+
+/* Returns the positions of the restart markers (RST0-RST7) in the entropy-coded data starting at the given byte, 
+   which ends at the first other marker. Each position is that of the 0xFF byte directly before the marker code, 
+   after any fill bytes. */
+std::vector<size_t> jpeg::BitStream::findRestartMarkers(size_t startOfScanData) const{
+    std::vector<size_t> restartMarkerPositions;
+    for (size_t position = startOfScanData ; position + 1 < m_stream.size() ; ++position){
+        if (m_stream[position] == 0xFF){
+            // Byte stuffing means that a 0xFF byte of entropy-coded data is followed by 0x00, so a second 0xFF byte
+            // can only be a fill byte before a marker
+            position = skipFillBytes(position);
+            if (position + 1 >= m_stream.size()){
+                break;
+            }
+            uint8_t const nextByte = m_stream[position + 1];
+            if (nextByte >= 0xD0 && nextByte <= 0xD7){
+                restartMarkerPositions.push_back(position);
+            }
+            else if (nextByte != 0x00){
+                break;
+            }
+            ++position;
         }
     }
+    return restartMarkerPositions;
 }
 
-void jpeg::BitStream::removeStuffedBytes(BitStreamReadProgress const& progress){
-    for (auto byte = m_stream.begin() + progress.currentByte ; byte != m_stream.end() - 2 /* Ignore EOI marker */; ){              
-        if (*byte == 0xFF && *(++byte) == 0x00){
-            // Note that due to byte stuffing it is not possible for two 0xFF bytes to be consecutive
-            m_stream.erase(byte);
+/* Returns the position of the 0xFF byte directly before the code of the marker starting at the given byte, skipping
+   the 0xFF fill bytes that any marker may be preceded by (Section B.1.1.2 of ITU-T81) */
+size_t jpeg::BitStream::skipFillBytes(size_t position) const{
+    while (position + 1 < m_stream.size() && m_stream[position] == 0xFF && m_stream[position + 1] == 0xFF){
+        ++position;
+    }
+    return position;
+}
+
+/* Returns the position of the first marker (or of the fill bytes before it) in the entropy-coded data starting at
+   the given byte, or the size of the stream if there is none */
+size_t jpeg::BitStream::findNextMarker(size_t position) const{
+    for ( ; position + 1 < m_stream.size() ; ++position){
+        if (m_stream[position] == 0xFF){
+            if (m_stream[position + 1] != 0x00){
+                return position;
+            }
+            ++position;
+        }
+    }
+    return m_stream.size();
+}
+
+jpeg::BitReader::BitReader(std::span<uint8_t const> data, size_t position) : m_data{data}, m_position{position}, m_buffer{0},
+                                                                             m_bitsInBuffer{0}, m_bitsReadBeyondMarker{0}, m_markerReached{false}{
+}
+
+/* Loads bytes until the buffer holds more than 56 bits, or a marker (or the end of the data) is reached */
+void jpeg::BitReader::refill(){
+    while (m_bitsInBuffer <= 56 && !m_markerReached){
+        // Load four bytes at once if none of them is 0xFF (so none may begin a marker or be followed by stuffing)
+        if (m_bitsInBuffer <= 32 && m_position + 4 <= m_data.size()){
+            uint32_t const word = (uint32_t(m_data[m_position]) << 24) | (uint32_t(m_data[m_position + 1]) << 16)
+                                | (uint32_t(m_data[m_position + 2]) << 8) | uint32_t(m_data[m_position + 3]);
+            // Non-zero if and only if a byte of ~word is zero
+            if (((~word - 0x01010101u) & word & 0x80808080u) == 0){
+                m_buffer = (m_buffer << 32) | word;
+                m_bitsInBuffer += 32;
+                m_position += 4;
+                continue;
+            }
+        }
+        if (m_position >= m_data.size()){
+            m_markerReached = true;
+            break;
+        }
+        uint8_t const byte = m_data[m_position];
+        if (byte == 0xFF){
+            if (m_position + 1 < m_data.size() && m_data[m_position + 1] == 0x00){
+                m_position += 2;
+            }
+            else{
+                m_markerReached = true;
+                break;
+            }
         }
         else{
-            ++byte;
+            ++m_position;
         }
+        m_buffer = (m_buffer << 8) | byte;
+        m_bitsInBuffer += 8;
+    }
+}
 
+/* Returns the position of the first byte that has not been read from, once any partially read byte is skipped. If
+   bits were read beyond a marker, the position lies beyond the marker. */
+size_t jpeg::BitReader::getAlignedPosition() const{
+    if (m_bitsReadBeyondMarker > 0){
+        return m_position + (m_bitsReadBeyondMarker + 7) / 8;
     }
-}
\ No newline at end of file
+    // Step back over the bytes in the buffer which have not been read from, and the bytes stuffed after them
+    size_t position = m_position;
+    for (size_t unreadBytes = m_bitsInBuffer / 8 ; unreadBytes > 0 ; --unreadBytes){
+        --position;
+        if (m_data[position] == 0x00 && m_data[position - 1] == 0xFF){
+            --position;
+        }
+    }
+    return position;
+}
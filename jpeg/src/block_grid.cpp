@@ -1,25 +1,23 @@
 #include "block_grid.hpp"
 
-jpeg::InputBlockGrid::InputBlockGrid(BitmapImageRGB const& input) : m_imageData{input}{};
+jpeg::InputBlockGrid::InputBlockGrid(ImageView const& input) : m_imageData{input}{};
 
-jpeg::InputBlockGrid::BlockIterator::BlockIterator(underlying_pointer p, uint16_t w, uint16_t h) : 
-    m_ptr{p}, m_blockRowPos{0}, m_blockColPos{0}, m_gridWidth{w}, m_gridHeight{h}{}
+jpeg::InputBlockGrid::BlockIterator::BlockIterator(ImageView const& image, uint16_t blockRow) : 
+    m_image{image}, m_blockRowPos{blockRow}, m_blockColPos{0},
+    m_numBlockRows(image.m_height / blockSize + ((image.m_height % blockSize) != 0)), 
+    m_numBlockCols(image.m_width / blockSize + ((image.m_width % blockSize) != 0)){}
 
 jpeg::InputBlockGrid::BlockIterator::value_type jpeg::InputBlockGrid::BlockIterator::operator*() const{
     Block output{};
-    uint8_t const bottomRemainder = m_gridHeight % blockSize;
+    uint8_t const bottomRemainder = m_image.m_height % blockSize;
     uint8_t const rowsToOutput = isLastRow() ? (bottomRemainder == 0 ? blockSize : bottomRemainder): blockSize;
-    uint8_t const rightRemainder = m_gridWidth % blockSize;
+    uint8_t const rightRemainder = m_image.m_width % blockSize;
     uint8_t const colsToOutput = isLastCol() ? (rightRemainder == 0 ? blockSize : rightRemainder): blockSize;
 
-
     for (int row = 0 ; row < rowsToOutput ; ++row){
-        for (int col = 0 ; col < colsToOutput ; ++col){
-            output.m_blockPixelData[row * blockSize + col] = m_ptr[row * m_gridWidth + col];
-        }
-        for (int col = colsToOutput - 1 ; col < blockSize ; ++col){
-            output.m_blockPixelData[row * blockSize + col] = m_ptr[row * m_gridWidth + colsToOutput - 1];
-        }
+        BitmapImageRGB::PixelData* const outputRow = output.m_blockPixelData.data() + row * blockSize;
+        m_image.copyRow(m_blockRowPos * blockSize + row, m_blockColPos * blockSize, colsToOutput, outputRow);
+        std::fill(outputRow + colsToOutput, outputRow + blockSize, outputRow[colsToOutput - 1]);
     }   
     for (int row = rowsToOutput ; row < blockSize ; ++row){
         std::copy(output.m_blockPixelData.begin() + (rowsToOutput - 1) * blockSize, output.m_blockPixelData.begin() + rowsToOutput * blockSize, output.m_blockPixelData.begin() + row * blockSize);
@@ -30,30 +28,13 @@ jpeg::InputBlockGrid::BlockIterator::value_type jpeg::InputBlockGrid::BlockItera
 jpeg::InputBlockGrid::BlockIterator& jpeg::InputBlockGrid::BlockIterator::operator++(){
     if (!isLastCol()){
         // Advance to next block in current block-row
-        m_ptr += blockSize;
         ++m_blockColPos;
     }
     else{
         // Advance to start of next block-row 
-        uint8_t offsetToNextDataRow = m_gridWidth % blockSize;
-        if (offsetToNextDataRow == 0){
-            offsetToNextDataRow = blockSize;
-        }
-        m_ptr += offsetToNextDataRow;
-        if (!isLastRow()){
-            m_ptr += (blockSize - 1) * m_gridWidth;
-        }
-        else{
-            uint8_t remainingDataRows = (m_gridHeight % blockSize);
-            if (remainingDataRows == 0){
-                remainingDataRows = blockSize;
-            }
-            uint32_t offsetToNextBlockRow = (remainingDataRows - 1) * m_gridWidth;
-            m_ptr += offsetToNextBlockRow;  
-        }      
         m_blockColPos = 0;
         ++m_blockRowPos;
-        }
+    }
     return *this;
 }
 
@@ -62,53 +43,77 @@ jpeg::InputBlockGrid::BlockIterator jpeg::InputBlockGrid::BlockIterator::operato
 }
 
 bool jpeg::InputBlockGrid::BlockIterator::isLastCol() const{
-    return ((m_blockColPos + 1) == (m_gridWidth / blockSize + ((m_gridWidth % blockSize) != 0)));
+    return (m_blockColPos + 1) == m_numBlockCols;
 }
 
 bool jpeg::InputBlockGrid::BlockIterator::isLastRow() const{
-    return ((m_blockRowPos + 1) == (m_gridHeight / blockSize + ((m_gridHeight % blockSize) != 0)));
-}
-
-jpeg::InputBlockGrid::BlockIterator::underlying_pointer jpeg::InputBlockGrid::BlockIterator::getDataPtr() const{
-    return m_ptr;
+    return (m_blockRowPos + 1) == m_numBlockRows;
 }
 
 jpeg::InputBlockGrid::BlockIterator jpeg::InputBlockGrid::begin() const{
-    return BlockIterator(m_imageData.m_imageData.data(), m_imageData.m_width, m_imageData.height);
+    return beginBlockRow(0);
 }
 
 jpeg::InputBlockGrid::BlockIterator jpeg::InputBlockGrid::end() const{
-    return BlockIterator(m_imageData.m_imageData.data() + m_imageData.m_width * m_imageData.height, m_imageData.m_width, m_imageData.height);
+    return BlockIterator(m_imageData, getNumBlockRows());
+}
+
+/* Returns an iterator to the first block in the given block-row, or end() if there is no such row */
+jpeg::InputBlockGrid::BlockIterator jpeg::InputBlockGrid::beginBlockRow(uint16_t blockRow) const{
+    return BlockIterator(m_imageData, std::min(blockRow, getNumBlockRows()));
+}
+
+uint16_t jpeg::InputBlockGrid::getNumBlockRows() const{
+    return m_imageData.m_height / blockSize + ((m_imageData.m_height % blockSize) != 0);
+}
+
+uint16_t jpeg::InputBlockGrid::getNumBlockCols() const{
+    return m_imageData.m_width / blockSize + ((m_imageData.m_width % blockSize) != 0);
 }
 
-jpeg::OutputBlockGrid::OutputBlockGrid(uint16_t width, uint16_t height) : 
-    m_output{width, height},  m_blockGrid{m_output}, m_currentBlock{m_blockGrid.begin()}, m_gridWidth{width}, m_gridHeight{height}{}
+jpeg::OutputBlockGrid::OutputBlockGrid(uint16_t width, uint16_t height, uint8_t scaleDenominator) : 
+    m_output(width / scaleDenominator + ((width % scaleDenominator) != 0), height / scaleDenominator + ((height % scaleDenominator) != 0)), 
+    m_gridWidth{m_output.m_width}, m_gridHeight{m_output.height}, m_outputBlockSize(blockSize / scaleDenominator),
+    m_numBlockCols(width / blockSize + ((width % blockSize) != 0)), m_numBlockRows(height / blockSize + ((height % blockSize) != 0)),
+    m_nextBlock{0}, m_processedBlocks{0}{}
 
 void jpeg::OutputBlockGrid::processNextBlock(BlockGrid::Block const& inputBlock){
-    uint8_t const bottomRemainder = m_gridHeight % blockSize;
-    uint8_t const rowsToCopy = m_currentBlock.isLastRow() ? (bottomRemainder == 0 ? blockSize : bottomRemainder): blockSize;
-    uint8_t const rightRemainder = m_gridWidth % blockSize;
-    uint8_t const colsToCopy = m_currentBlock.isLastCol() ? (rightRemainder == 0 ? blockSize : rightRemainder): blockSize;
+    processBlock(m_nextBlock++, inputBlock);
+}
+
+void jpeg::OutputBlockGrid::processBlock(size_t blockIndex, BlockGrid::Block const& inputBlock){
+    assert(blockIndex < getNumBlocks());
+    size_t const blockRow = blockIndex / m_numBlockCols;
+    size_t const blockCol = blockIndex % m_numBlockCols;
+    // Blocks in the last row and column may be cropped
+    size_t const rowsToCopy = std::min<size_t>(m_outputBlockSize, m_gridHeight - blockRow * m_outputBlockSize);
+    size_t const colsToCopy = std::min<size_t>(m_outputBlockSize, m_gridWidth - blockCol * m_outputBlockSize);
 
+    BitmapImageRGB::PixelData* const blockPtr = m_output.m_imageData.data() + blockRow * m_outputBlockSize * m_gridWidth + blockCol * m_outputBlockSize;
     for (size_t i = 0 ; i < rowsToCopy ; ++i){
-                std::copy(inputBlock.m_blockPixelData.data() + i * blockSize ,
-                          inputBlock.m_blockPixelData.data() + i * blockSize + colsToCopy, 
-                          getBlockPtr() + i * m_gridWidth);
+                std::copy(inputBlock.m_blockPixelData.data() + i * m_outputBlockSize,
+                          inputBlock.m_blockPixelData.data() + i * m_outputBlockSize + colsToCopy, 
+                          blockPtr + i * m_gridWidth);
     }
-    ++m_currentBlock;
+    ++m_processedBlocks;
+}
+
+size_t jpeg::OutputBlockGrid::getNumBlocks() const{
+    return size_t(m_numBlockCols) * m_numBlockRows;
+}
+
+/* The number of pixels in each row and column of a decoded block */
+uint8_t jpeg::OutputBlockGrid::getOutputBlockSize() const{
+    return m_outputBlockSize;
 }
 
 jpeg::BitmapImageRGB jpeg::OutputBlockGrid::getBitmapRGB() const{
-    if (m_currentBlock != m_blockGrid.end()){
+    if (!atEnd()){
         std::cerr << "Warning: not all JPEG blocks processed. Decoded Bitmap may be incomplete!\n";
     }
     return m_output;
 }
 
 bool jpeg::OutputBlockGrid::atEnd() const{
-    return m_currentBlock == m_blockGrid.end();
-}
-
-jpeg::BitmapImageRGB::PixelData* jpeg::OutputBlockGrid::getBlockPtr(){
-    return m_output.m_imageData.data() + (m_currentBlock.getDataPtr() - m_blockGrid.begin().getDataPtr());
+    return m_processedBlocks == getNumBlocks();
 }
\ No newline at end of file
@@ -5,11 +5,58 @@ jpeg::DctBlockChannelData jpeg::DiscreteCosineTransformer::transform(ColourMappe
     return applyTransform(offsetChannelData);
 }
 
-jpeg::ColourMappedBlockData::BlockChannelData jpeg::DiscreteCosineTransformer::inverseTransform(DctBlockChannelData  const& inputChannel) const{
-    std::array<int8_t, BlockGrid::blockElements> offsetChannelData = applyInverseTransform(inputChannel);
+/* An output size less than blockSize gives a reduced-size inverse transform (see applyScaledInverseTransform) */
+jpeg::ColourMappedBlockData::BlockChannelData jpeg::DiscreteCosineTransformer::inverseTransform(DctBlockChannelData  const& inputChannel, uint8_t outputSize) const{
+    std::array<int8_t, BlockGrid::blockElements> offsetChannelData = (outputSize == BlockGrid::blockSize) ? applyInverseTransform(inputChannel)
+                                                                                                         : applyScaledInverseTransform(inputChannel, outputSize);
     return removeOffset(offsetChannelData);
 }
 
+/* Calculates outputSize x outputSize samples (for an output size of 1, 2 or 4), by applying an outputSize-point IDCT
+   to the lowest outputSize x outputSize frequencies of the block. Each sample approximates the mean of the
+   corresponding square of the full inverse transform. The samples are stored at the start of the output, in raster
+   order. This implementation expects coefficients without any scale factors. */
+std::array<int8_t, jpeg::BlockGrid::blockElements> jpeg::DiscreteCosineTransformer::applyScaledInverseTransform(DctBlockChannelData const& inputChannel, uint8_t outputSize) const{
+    // The basis functions of the reduced transforms are cos((2x + 1) * u * (blockSize / outputSize) * pi / 16), 
+    // so are all found in a table of cos(k * pi / 16) over a full period
+    std::array<float, 4 * BlockGrid::blockSize> const static cosines = []{
+        std::array<float, 4 * BlockGrid::blockSize> table;
+        for (size_t k = 0 ; k < table.size() ; ++k){
+            table[k] = std::cos(k * std::numbers::pi_v<float> / 16.0f);
+        }
+        return table;
+    }();
+    size_t const frequencyStep = BlockGrid::blockSize / outputSize;
+    auto const basis = [&](size_t position, size_t frequency){
+        return cosines[((2 * position + 1) * frequency * frequencyStep) % cosines.size()];
+    };
+    auto const scaleFactor = [](size_t frequency){return 0.5f * ((frequency == 0) ? 1/std::sqrt(2.0f) : 1);};
+    // Coefficients outside of the non-zero extent may be skipped
+    size_t const numFrequencies = std::min(outputSize, inputChannel.m_nonZeroExtent);
+
+    std::array<float, BlockGrid::blockElements> rowInverseDCT;
+    for (size_t v = 0 ; v < numFrequencies ; ++v){
+        for (size_t x = 0 ; x < outputSize ; ++x){
+            float accumulator = 0;
+            for (size_t u = 0 ; u < numFrequencies ; ++u){
+                accumulator += scaleFactor(u) * basis(x, u) * inputChannel.m_data[u + v * BlockGrid::blockSize];
+            }
+            rowInverseDCT[x + v * outputSize] = accumulator;
+        }
+    }
+    std::array<int8_t, BlockGrid::blockElements> offsetChannelData{};
+    for (size_t y = 0 ; y < outputSize ; ++y){
+        for (size_t x = 0 ; x < outputSize ; ++x){
+            float accumulator = 0;
+            for (size_t v = 0 ; v < numFrequencies ; ++v){
+                accumulator += scaleFactor(v) * basis(y, v) * rowInverseDCT[x + v * outputSize];
+            }
+            offsetChannelData[x + y * outputSize] = std::clamp(accumulator, -128.0f, 127.0f);
+        }
+    }
+    return offsetChannelData;
+}
+
 std::array<int8_t, jpeg::BlockGrid::blockElements> jpeg::DiscreteCosineTransformer::applyOffset(ColourMappedBlockData::BlockChannelData const& input) const{
     std::array<int8_t, BlockGrid::blockElements> offsetData;
     for (size_t i = 0 ; i < BlockGrid::blockElements ; ++i){
@@ -88,14 +135,40 @@ jpeg::DctBlockChannelData jpeg::SeparatedDiscreteCosineTransformer::applyTransfo
 }
 
 std::array<int8_t, jpeg::BlockGrid::blockElements> jpeg::SeparatedDiscreteCosineTransformer::applyInverseTransform(DctBlockChannelData  const& inputChannel) const{
-    std::array<float, BlockGrid::blockElements> rowInverseDCT;
-    for (size_t x = 0 ; x < BlockGrid::blockSize ; ++x){
-        apply1DInverseTransformRow(inputChannel.m_data.data(), rowInverseDCT.data() + x * BlockGrid::blockSize, x);
+    switch (inputChannel.m_nonZeroExtent){
+        case 1:
+            return applySparseInverseTransform<1>(inputChannel);
+        case 2:
+            return applySparseInverseTransform<2>(inputChannel);
+        case 4:
+            return applySparseInverseTransform<4>(inputChannel);
+        default:
+            return applySparseInverseTransform<BlockGrid::blockSize>(inputChannel);
     }
+}
 
+/* Inverse transforms a block whose non-zero coefficients all lie in its top-left extent x extent corner */
+template <size_t extent>
+std::array<int8_t, jpeg::BlockGrid::blockElements> jpeg::SeparatedDiscreteCosineTransformer::applySparseInverseTransform(DctBlockChannelData const& inputChannel) const{
+    std::array<float, BlockGrid::blockElements> rowInverseDCT;
     std::array<int8_t, BlockGrid::blockElements> offsetChannelData;
+    if constexpr (extent == 1){
+        // The DC basis function is constant, so a single row is calculated and copied to the rest of the block
+        apply1DInverseTransformRow<extent>(inputChannel.m_data.data(), rowInverseDCT.data(), 0);
+        for (size_t x = 1 ; x < BlockGrid::blockSize ; ++x){
+            rowInverseDCT[x * BlockGrid::blockSize] = rowInverseDCT[0];
+        }
+        apply1DInverseTransformCol<extent>(rowInverseDCT.data(), offsetChannelData.data(), 0);
+        for (size_t y = 1 ; y < BlockGrid::blockSize ; ++y){
+            std::copy_n(offsetChannelData.begin(), BlockGrid::blockSize, offsetChannelData.begin() + y * BlockGrid::blockSize);
+        }
+        return offsetChannelData;
+    }
+    for (size_t x = 0 ; x < BlockGrid::blockSize ; ++x){
+        apply1DInverseTransformRow<extent>(inputChannel.m_data.data(), rowInverseDCT.data() + x * BlockGrid::blockSize, x);
+    }
     for (size_t y = 0 ; y < BlockGrid::blockSize ; ++y){
-        apply1DInverseTransformCol(rowInverseDCT.data(), offsetChannelData.data(), y);
+        apply1DInverseTransformCol<extent>(rowInverseDCT.data(), offsetChannelData.data(), y);
     }
     return offsetChannelData;
 }
@@ -123,21 +196,24 @@ void jpeg::SeparatedDiscreteCosineTransformer::apply1DTransformCol(float const*
     }
 }
 
+/* Only the first extent frequencies of the first extent rows are read, and only the first extent outputs are written */
+template <size_t extent>
 void jpeg::SeparatedDiscreteCosineTransformer::apply1DInverseTransformRow(float const* src, float* dest, uint8_t x) const{
-    for (size_t v = 0 ; v < BlockGrid::blockSize ; ++v){
+    for (size_t v = 0 ; v < extent ; ++v){
         float accumulator = 0;
-        for (size_t u = 0 ; u < BlockGrid::blockSize ; ++u){
+        for (size_t u = 0 ; u < extent ; ++u){
             float const scaleFactor = 0.5f * ((u == 0) ? 1/std::sqrt(2.0f) : 1);
             accumulator += scaleFactor * std::cos((2.0f * x + 1) * u * std::numbers::pi_v<float> / 16.0f) * src[u + v * BlockGrid::blockSize];
         }
         dest[v] = accumulator;
     }
 }
+template <size_t extent>
 void jpeg::SeparatedDiscreteCosineTransformer::apply1DInverseTransformCol(float const* src, int8_t* dest, uint8_t y) const{    
     int8_t* const output = dest + y * BlockGrid::blockSize;
     for (size_t x = 0 ; x < BlockGrid::blockSize ; ++x){
         float accumulator = 0;
-        for (size_t v = 0 ; v < BlockGrid::blockSize ; ++v){
+        for (size_t v = 0 ; v < extent ; ++v){
             float const scaleFactor = 0.5f * ((v == 0) ? 1/std::sqrt(2.0f) : 1);
             accumulator += scaleFactor * std::cos((2.0f * y + 1) * v * std::numbers::pi_v<float> / 16.0f) * src[v + x * BlockGrid::blockSize];
         }
@@ -153,4 +229,310 @@ void jpeg::SeparatedDiscreteCosineTransformer::apply1DInverseTransformCol(float
             output[x] = accumulator;
         }
     }
-}
\ No newline at end of file
+}
+
+std::array<float, jpeg::BlockGrid::blockElements> jpeg::DiscreteCosineTransformer::getForwardScaleFactors() const{
+    std::array<float, BlockGrid::blockElements> scaleFactors;
+    scaleFactors.fill(1);
+    return scaleFactors;
+}
+
+std::array<float, jpeg::BlockGrid::blockElements> jpeg::DiscreteCosineTransformer::getInverseScaleFactors() const{
+    std::array<float, BlockGrid::blockElements> scaleFactors;
+    scaleFactors.fill(1);
+    return scaleFactors;
+}
+
+/* Coefficient (u, v) of the forward transform is left scaled by 8 * s(u) * s(v) */
+std::array<float, jpeg::BlockGrid::blockElements> jpeg::AANDiscreteCosineTransformer::getForwardScaleFactors() const{
+    std::array<float, BlockGrid::blockElements> scaleFactors;
+    for (size_t i = 0 ; i < BlockGrid::blockElements ; ++i){
+        scaleFactors[i] = 8 * getAANScaleFactor(i % BlockGrid::blockSize) * getAANScaleFactor(i / BlockGrid::blockSize);
+    }
+    return scaleFactors;
+}
+
+/* Coefficient (u, v) of the inverse transform is expected to be scaled by s(u) * s(v) / 8 */
+std::array<float, jpeg::BlockGrid::blockElements> jpeg::AANDiscreteCosineTransformer::getInverseScaleFactors() const{
+    std::array<float, BlockGrid::blockElements> scaleFactors;
+    for (size_t i = 0 ; i < BlockGrid::blockElements ; ++i){
+        scaleFactors[i] = getAANScaleFactor(i % BlockGrid::blockSize) * getAANScaleFactor(i / BlockGrid::blockSize) / 8;
+    }
+    return scaleFactors;
+}
+
+/* Uses the requested SIMD level, or the closest level supported by the CPU */
+jpeg::AANDiscreteCosineTransformer::AANDiscreteCosineTransformer(SimdLevel simdLevel) : m_simdLevel{std::min(simdLevel, getSupportedSimdLevel())},
+                                                                                        m_inverseScaleFactors{AANDiscreteCosineTransformer::getInverseScaleFactors()}{
+}
+
+jpeg::SimdLevel jpeg::AANDiscreteCosineTransformer::getSimdLevel() const{
+    return m_simdLevel;
+}
+
+/* s(0) = 1, s(k) = sqrt(2) * cos(k * pi / 16) */
+float jpeg::AANDiscreteCosineTransformer::getAANScaleFactor(size_t frequency){
+    return (frequency == 0) ? 1.0f : float(std::numbers::sqrt2 * std::cos(frequency * std::numbers::pi / 16));
+}
+
+jpeg::DctBlockChannelData jpeg::AANDiscreteCosineTransformer::applyTransform(std::array<int8_t, BlockGrid::blockElements> const& inputChannel) const{
+    DctBlockChannelData output;
+#if JPEG_SIMD_X86
+    if (m_simdLevel == SimdLevel::AVX2){
+        applyTransformAVX2(inputChannel.data(), output.m_data.data());
+        return output;
+    }
+    if (m_simdLevel == SimdLevel::SSE2){
+        applyTransformSSE2(inputChannel.data(), output.m_data.data());
+        return output;
+    }
+#endif
+    std::copy(inputChannel.begin(), inputChannel.end(), output.m_data.begin());
+    for (size_t y = 0 ; y < BlockGrid::blockSize ; ++y){
+        apply1DTransform(output.m_data.data() + y * BlockGrid::blockSize, 1);
+    }
+    for (size_t u = 0 ; u < BlockGrid::blockSize ; ++u){
+        apply1DTransform(output.m_data.data() + u, BlockGrid::blockSize);
+    }
+    return output;
+}
+
+std::array<int8_t, jpeg::BlockGrid::blockElements> jpeg::AANDiscreteCosineTransformer::applyInverseTransform(DctBlockChannelData  const& inputChannel) const{
+    std::array<int8_t, BlockGrid::blockElements> offsetChannelData;
+#if JPEG_SIMD_X86
+    if (m_simdLevel == SimdLevel::AVX2){
+        applyInverseTransformAVX2(inputChannel.m_data.data(), offsetChannelData.data());
+        return offsetChannelData;
+    }
+    if (m_simdLevel == SimdLevel::SSE2){
+        applyInverseTransformSSE2(inputChannel.m_data.data(), offsetChannelData.data());
+        return offsetChannelData;
+    }
+#endif
+    std::array<float, BlockGrid::blockElements> workspace = inputChannel.m_data;
+    for (size_t u = 0 ; u < BlockGrid::blockSize ; ++u){
+        apply1DInverseTransform(workspace.data() + u, BlockGrid::blockSize);
+    }
+    for (size_t y = 0 ; y < BlockGrid::blockSize ; ++y){
+        apply1DInverseTransform(workspace.data() + y * BlockGrid::blockSize, 1);
+    }
+    for (size_t i = 0 ; i < BlockGrid::blockElements ; ++i){
+        offsetChannelData[i] = std::clamp(workspace[i], -128.0f, 127.0f);
+    }
+    return offsetChannelData;
+}
+
+/* Removes the scale factors from the coefficients used by the reduced-size transform */
+std::array<int8_t, jpeg::BlockGrid::blockElements> jpeg::AANDiscreteCosineTransformer::applyScaledInverseTransform(DctBlockChannelData const& inputChannel, uint8_t outputSize) const{
+    DctBlockChannelData unscaledInput = inputChannel;
+    for (size_t v = 0 ; v < outputSize ; ++v){
+        for (size_t u = 0 ; u < outputSize ; ++u){
+            unscaledInput.m_data[u + v * BlockGrid::blockSize] /= m_inverseScaleFactors[u + v * BlockGrid::blockSize];
+        }
+    }
+    return DiscreteCosineTransformer::applyScaledInverseTransform(unscaledInput, outputSize);
+}
+
+/* In-place scaled 8-point DCT of the elements data[0], data[stride], ..., data[7 * stride] */
+void jpeg::AANDiscreteCosineTransformer::apply1DTransform(float* data, size_t stride) const{
+    float const tmp0 = data[0 * stride] + data[7 * stride];
+    float const tmp7 = data[0 * stride] - data[7 * stride];
+    float const tmp1 = data[1 * stride] + data[6 * stride];
+    float const tmp6 = data[1 * stride] - data[6 * stride];
+    float const tmp2 = data[2 * stride] + data[5 * stride];
+    float const tmp5 = data[2 * stride] - data[5 * stride];
+    float const tmp3 = data[3 * stride] + data[4 * stride];
+    float const tmp4 = data[3 * stride] - data[4 * stride];
+
+    // Even part
+    float const tmp10 = tmp0 + tmp3;
+    float const tmp13 = tmp0 - tmp3;
+    float const tmp11 = tmp1 + tmp2;
+    float const tmp12 = tmp1 - tmp2;
+    data[0 * stride] = tmp10 + tmp11;
+    data[4 * stride] = tmp10 - tmp11;
+    float const z1 = (tmp12 + tmp13) * 0.707106781f; // c4
+    data[2 * stride] = tmp13 + z1;
+    data[6 * stride] = tmp13 - z1;
+
+    // Odd part
+    float const tmp14 = tmp4 + tmp5;
+    float const tmp15 = tmp5 + tmp6;
+    float const tmp16 = tmp6 + tmp7;
+    float const z5 = (tmp14 - tmp16) * 0.382683433f; // c6
+    float const z2 = 0.541196100f * tmp14 + z5; // c2 - c6
+    float const z4 = 1.306562965f * tmp16 + z5; // c2 + c6
+    float const z3 = tmp15 * 0.707106781f; // c4
+    float const z11 = tmp7 + z3;
+    float const z13 = tmp7 - z3;
+    data[5 * stride] = z13 + z2;
+    data[3 * stride] = z13 - z2;
+    data[1 * stride] = z11 + z4;
+    data[7 * stride] = z11 - z4;
+}
+
+/* In-place scaled 8-point IDCT of the elements data[0], data[stride], ..., data[7 * stride] */
+void jpeg::AANDiscreteCosineTransformer::apply1DInverseTransform(float* data, size_t stride) const{
+    // Even part
+    float const tmp10 = data[0 * stride] + data[4 * stride];
+    float const tmp11 = data[0 * stride] - data[4 * stride];
+    float const tmp13 = data[2 * stride] + data[6 * stride];
+    float const tmp12 = (data[2 * stride] - data[6 * stride]) * 1.414213562f - tmp13; // 2 * c4
+    float const tmp0 = tmp10 + tmp13;
+    float const tmp3 = tmp10 - tmp13;
+    float const tmp1 = tmp11 + tmp12;
+    float const tmp2 = tmp11 - tmp12;
+
+    // Odd part
+    float const z13 = data[5 * stride] + data[3 * stride];
+    float const z10 = data[5 * stride] - data[3 * stride];
+    float const z11 = data[1 * stride] + data[7 * stride];
+    float const z12 = data[1 * stride] - data[7 * stride];
+    float const tmp7 = z11 + z13;
+    float const tmp21 = (z11 - z13) * 1.414213562f; // 2 * c4
+    float const z5 = (z10 + z12) * 1.847759065f; // 2 * c2
+    float const tmp20 = 1.082392200f * z12 - z5; // 2 * (c2 - c6)
+    float const tmp22 = -2.613125930f * z10 + z5; // -2 * (c2 + c6)
+    float const tmp6 = tmp22 - tmp7;
+    float const tmp5 = tmp21 - tmp6;
+    float const tmp4 = tmp20 + tmp5;
+
+    data[0 * stride] = tmp0 + tmp7;
+    data[7 * stride] = tmp0 - tmp7;
+    data[1 * stride] = tmp1 + tmp6;
+    data[6 * stride] = tmp1 - tmp6;
+    data[2 * stride] = tmp2 + tmp5;
+    data[5 * stride] = tmp2 - tmp5;
+    data[4 * stride] = tmp3 + tmp4;
+    data[3 * stride] = tmp3 - tmp4;
+}
+
+std::array<float, jpeg::BlockGrid::blockElements> jpeg::IntegerDiscreteCosineTransformer::getForwardScaleFactors() const{
+    std::array<float, BlockGrid::blockElements> scaleFactors;
+    scaleFactors.fill(8);
+    return scaleFactors;
+}
+
+jpeg::DctBlockChannelData jpeg::IntegerDiscreteCosineTransformer::applyTransform(std::array<int8_t, BlockGrid::blockElements> const& inputChannel) const{
+    std::array<int32_t, BlockGrid::blockElements> workspace;
+    std::copy(inputChannel.begin(), inputChannel.end(), workspace.begin());
+    // Rows are scaled up by 2^pass1Bits, and the scaling is removed by the column pass
+    for (size_t y = 0 ; y < BlockGrid::blockSize ; ++y){
+        apply1DTransform<-pass1Bits, constBits - pass1Bits>(workspace.data() + y * BlockGrid::blockSize, 1);
+    }
+    for (size_t u = 0 ; u < BlockGrid::blockSize ; ++u){
+        apply1DTransform<pass1Bits, constBits + pass1Bits>(workspace.data() + u, BlockGrid::blockSize);
+    }
+    DctBlockChannelData output;
+    std::copy(workspace.begin(), workspace.end(), output.m_data.begin());
+    return output;
+}
+
+std::array<int8_t, jpeg::BlockGrid::blockElements> jpeg::IntegerDiscreteCosineTransformer::applyInverseTransform(DctBlockChannelData  const& inputChannel) const{
+    // Dequantised coefficients are always integral, so are converted exactly
+    std::array<int32_t, BlockGrid::blockElements> workspace;
+    std::copy(inputChannel.m_data.begin(), inputChannel.m_data.end(), workspace.begin());
+    for (size_t u = 0 ; u < BlockGrid::blockSize ; ++u){
+        apply1DInverseTransform<constBits - pass1Bits>(workspace.data() + u, BlockGrid::blockSize);
+    }
+    // Removes the scaling of the column pass, and the factor of 8 of the 2D IDCT
+    for (size_t y = 0 ; y < BlockGrid::blockSize ; ++y){
+        apply1DInverseTransform<constBits + pass1Bits + 3>(workspace.data() + y * BlockGrid::blockSize, 1);
+    }
+
+    std::array<int8_t, BlockGrid::blockElements> offsetChannelData;
+    for (size_t i = 0 ; i < BlockGrid::blockElements ; ++i){
+        offsetChannelData[i] = std::clamp<int32_t>(workspace[i], -128, 127);
+    }
+    return offsetChannelData;
+}
+
+/* In-place 8-point DCT of the elements data[0], data[stride], ..., data[7 * stride]. The even outputs 0 and 4 are 
+   shifted left by -shiftEven (or descaled if positive), and the remaining outputs are descaled by shiftOdd. */
+template <int shiftEven, int shiftOdd>
+void jpeg::IntegerDiscreteCosineTransformer::apply1DTransform(int32_t* data, size_t stride) const{
+    int32_t const tmp0 = data[0 * stride] + data[7 * stride];
+    int32_t const tmp7 = data[0 * stride] - data[7 * stride];
+    int32_t const tmp1 = data[1 * stride] + data[6 * stride];
+    int32_t const tmp6 = data[1 * stride] - data[6 * stride];
+    int32_t const tmp2 = data[2 * stride] + data[5 * stride];
+    int32_t const tmp5 = data[2 * stride] - data[5 * stride];
+    int32_t const tmp3 = data[3 * stride] + data[4 * stride];
+    int32_t const tmp4 = data[3 * stride] - data[4 * stride];
+
+    // Even part
+    int32_t const tmp10 = tmp0 + tmp3;
+    int32_t const tmp13 = tmp0 - tmp3;
+    int32_t const tmp11 = tmp1 + tmp2;
+    int32_t const tmp12 = tmp1 - tmp2;
+    if constexpr (shiftEven < 0){
+        data[0 * stride] = (tmp10 + tmp11) * (int32_t(1) << -shiftEven);
+        data[4 * stride] = (tmp10 - tmp11) * (int32_t(1) << -shiftEven);
+    }
+    else{
+        data[0 * stride] = descale(tmp10 + tmp11, shiftEven);
+        data[4 * stride] = descale(tmp10 - tmp11, shiftEven);
+    }
+    int32_t const z1 = (tmp12 + tmp13) * fix_0_541196100;
+    data[2 * stride] = descale(z1 + tmp13 * fix_0_765366865, shiftOdd);
+    data[6 * stride] = descale(z1 - tmp12 * fix_1_847759065, shiftOdd);
+
+    // Odd part
+    int32_t const z5 = (tmp4 + tmp6 + tmp5 + tmp7) * fix_1_175875602;
+    int32_t const z1Odd = -(tmp4 + tmp7) * fix_0_899976223;
+    int32_t const z2 = -(tmp5 + tmp6) * fix_2_562915447;
+    int32_t const z3 = -(tmp4 + tmp6) * fix_1_961570560 + z5;
+    int32_t const z4 = -(tmp5 + tmp7) * fix_0_390180644 + z5;
+    data[7 * stride] = descale(tmp4 * fix_0_298631336 + z1Odd + z3, shiftOdd);
+    data[5 * stride] = descale(tmp5 * fix_2_053119869 + z2 + z4, shiftOdd);
+    data[3 * stride] = descale(tmp6 * fix_3_072711026 + z2 + z3, shiftOdd);
+    data[1 * stride] = descale(tmp7 * fix_1_501321110 + z1Odd + z4, shiftOdd);
+}
+
+/* In-place 8-point IDCT of the elements data[0], data[stride], ..., data[7 * stride], with the outputs descaled by shift */
+template <int shift>
+void jpeg::IntegerDiscreteCosineTransformer::apply1DInverseTransform(int32_t* data, size_t stride) const{
+    // Even part
+    int32_t const z1 = (data[2 * stride] + data[6 * stride]) * fix_0_541196100;
+    int32_t const tmp2 = z1 - data[6 * stride] * fix_1_847759065;
+    int32_t const tmp3 = z1 + data[2 * stride] * fix_0_765366865;
+    int32_t const tmp0 = (data[0 * stride] + data[4 * stride]) * (int32_t(1) << constBits);
+    int32_t const tmp1 = (data[0 * stride] - data[4 * stride]) * (int32_t(1) << constBits);
+    int32_t const tmp10 = tmp0 + tmp3;
+    int32_t const tmp13 = tmp0 - tmp3;
+    int32_t const tmp11 = tmp1 + tmp2;
+    int32_t const tmp12 = tmp1 - tmp2;
+
+    // Odd part
+    int32_t const in7 = data[7 * stride], in5 = data[5 * stride], in3 = data[3 * stride], in1 = data[1 * stride];
+    int32_t const z5 = (in7 + in3 + in5 + in1) * fix_1_175875602;
+    int32_t const z1Odd = -(in7 + in1) * fix_0_899976223;
+    int32_t const z2 = -(in5 + in3) * fix_2_562915447;
+    int32_t const z3 = -(in7 + in3) * fix_1_961570560 + z5;
+    int32_t const z4 = -(in5 + in1) * fix_0_390180644 + z5;
+    int32_t const odd0 = in7 * fix_0_298631336 + z1Odd + z3;
+    int32_t const odd1 = in5 * fix_2_053119869 + z2 + z4;
+    int32_t const odd2 = in3 * fix_3_072711026 + z2 + z3;
+    int32_t const odd3 = in1 * fix_1_501321110 + z1Odd + z4;
+
+    data[0 * stride] = descale(tmp10 + odd3, shift);
+    data[7 * stride] = descale(tmp10 - odd3, shift);
+    data[1 * stride] = descale(tmp11 + odd2, shift);
+    data[6 * stride] = descale(tmp11 - odd2, shift);
+    data[2 * stride] = descale(tmp12 + odd1, shift);
+    data[5 * stride] = descale(tmp12 - odd1, shift);
+    data[3 * stride] = descale(tmp13 + odd0, shift);
+    data[4 * stride] = descale(tmp13 - odd0, shift);
+}
+
+std::unique_ptr<jpeg::DiscreteCosineTransformer> jpeg::createDiscreteCosineTransformer(DctMethod method){
+    switch (method){
+        case DctMethod::AAN:
+            return std::make_unique<AANDiscreteCosineTransformer>();
+        case DctMethod::Integer:
+            return std::make_unique<IntegerDiscreteCosineTransformer>();
+        case DctMethod::Separated:
+        default:
+            return std::make_unique<SeparatedDiscreteCosineTransformer>();
+    }
+}
@@ -0,0 +1,205 @@
+#include "discrete_cosine_transform.hpp"
+
+#if JPEG_SIMD_X86
+#include <immintrin.h>
+
+/* The 1D transforms below operate lane-wise on 8 vectors, so transform 4 (SSE2) or 8 (AVX2) rows or columns at 
+   once. They perform exactly the same operations as the scalar transforms in AANDiscreteCosineTransformer. */
+namespace{
+    template <typename Vector>
+    [[gnu::always_inline]] inline void applyAAN1DTransform(Vector* data){
+        Vector const tmp0 = data[0] + data[7];
+        Vector const tmp7 = data[0] - data[7];
+        Vector const tmp1 = data[1] + data[6];
+        Vector const tmp6 = data[1] - data[6];
+        Vector const tmp2 = data[2] + data[5];
+        Vector const tmp5 = data[2] - data[5];
+        Vector const tmp3 = data[3] + data[4];
+        Vector const tmp4 = data[3] - data[4];
+
+        // Even part
+        Vector const tmp10 = tmp0 + tmp3;
+        Vector const tmp13 = tmp0 - tmp3;
+        Vector const tmp11 = tmp1 + tmp2;
+        Vector const tmp12 = tmp1 - tmp2;
+        data[0] = tmp10 + tmp11;
+        data[4] = tmp10 - tmp11;
+        Vector const z1 = (tmp12 + tmp13) * 0.707106781f;
+        data[2] = tmp13 + z1;
+        data[6] = tmp13 - z1;
+
+        // Odd part
+        Vector const tmp14 = tmp4 + tmp5;
+        Vector const tmp15 = tmp5 + tmp6;
+        Vector const tmp16 = tmp6 + tmp7;
+        Vector const z5 = (tmp14 - tmp16) * 0.382683433f;
+        Vector const z2 = 0.541196100f * tmp14 + z5;
+        Vector const z4 = 1.306562965f * tmp16 + z5;
+        Vector const z3 = tmp15 * 0.707106781f;
+        Vector const z11 = tmp7 + z3;
+        Vector const z13 = tmp7 - z3;
+        data[5] = z13 + z2;
+        data[3] = z13 - z2;
+        data[1] = z11 + z4;
+        data[7] = z11 - z4;
+    }
+
+    template <typename Vector>
+    [[gnu::always_inline]] inline void applyAAN1DInverseTransform(Vector* data){
+        // Even part
+        Vector const tmp10 = data[0] + data[4];
+        Vector const tmp11 = data[0] - data[4];
+        Vector const tmp13 = data[2] + data[6];
+        Vector const tmp12 = (data[2] - data[6]) * 1.414213562f - tmp13;
+        Vector const tmp0 = tmp10 + tmp13;
+        Vector const tmp3 = tmp10 - tmp13;
+        Vector const tmp1 = tmp11 + tmp12;
+        Vector const tmp2 = tmp11 - tmp12;
+
+        // Odd part
+        Vector const z13 = data[5] + data[3];
+        Vector const z10 = data[5] - data[3];
+        Vector const z11 = data[1] + data[7];
+        Vector const z12 = data[1] - data[7];
+        Vector const tmp7 = z11 + z13;
+        Vector const tmp21 = (z11 - z13) * 1.414213562f;
+        Vector const z5 = (z10 + z12) * 1.847759065f;
+        Vector const tmp20 = 1.082392200f * z12 - z5;
+        Vector const tmp22 = -2.613125930f * z10 + z5;
+        Vector const tmp6 = tmp22 - tmp7;
+        Vector const tmp5 = tmp21 - tmp6;
+        Vector const tmp4 = tmp20 + tmp5;
+
+        data[0] = tmp0 + tmp7;
+        data[7] = tmp0 - tmp7;
+        data[1] = tmp1 + tmp6;
+        data[6] = tmp1 - tmp6;
+        data[2] = tmp2 + tmp5;
+        data[5] = tmp2 - tmp5;
+        data[4] = tmp3 + tmp4;
+        data[3] = tmp3 - tmp4;
+    }
+
+    /* Transposes an 8x8 block held as the left (columns 0-3) and right (columns 4-7) halves of each row */
+    [[gnu::always_inline, gnu::target("sse2")]] inline void transposeSSE2(__m128* left, __m128* right){
+        _MM_TRANSPOSE4_PS(left[0], left[1], left[2], left[3]);
+        _MM_TRANSPOSE4_PS(right[0], right[1], right[2], right[3]);
+        _MM_TRANSPOSE4_PS(left[4], left[5], left[6], left[7]);
+        _MM_TRANSPOSE4_PS(right[4], right[5], right[6], right[7]);
+        for (size_t row = 0 ; row < 4 ; ++row){
+            std::swap(right[row], left[row + 4]);
+        }
+    }
+
+    /* Transposes an 8x8 block held as one vector per row */
+    [[gnu::always_inline, gnu::target("avx2")]] inline void transposeAVX2(__m256* rows){
+        __m256 const t0 = _mm256_unpacklo_ps(rows[0], rows[1]);
+        __m256 const t1 = _mm256_unpackhi_ps(rows[0], rows[1]);
+        __m256 const t2 = _mm256_unpacklo_ps(rows[2], rows[3]);
+        __m256 const t3 = _mm256_unpackhi_ps(rows[2], rows[3]);
+        __m256 const t4 = _mm256_unpacklo_ps(rows[4], rows[5]);
+        __m256 const t5 = _mm256_unpackhi_ps(rows[4], rows[5]);
+        __m256 const t6 = _mm256_unpacklo_ps(rows[6], rows[7]);
+        __m256 const t7 = _mm256_unpackhi_ps(rows[6], rows[7]);
+        __m256 const u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 const u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 const u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 const u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 const u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 const u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 const u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 const u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+        rows[0] = _mm256_permute2f128_ps(u0, u4, 0x20);
+        rows[1] = _mm256_permute2f128_ps(u1, u5, 0x20);
+        rows[2] = _mm256_permute2f128_ps(u2, u6, 0x20);
+        rows[3] = _mm256_permute2f128_ps(u3, u7, 0x20);
+        rows[4] = _mm256_permute2f128_ps(u0, u4, 0x31);
+        rows[5] = _mm256_permute2f128_ps(u1, u5, 0x31);
+        rows[6] = _mm256_permute2f128_ps(u2, u6, 0x31);
+        rows[7] = _mm256_permute2f128_ps(u3, u7, 0x31);
+    }
+}
+
+[[gnu::target("sse2")]] void jpeg::AANDiscreteCosineTransformer::applyTransformSSE2(int8_t const* input, float* output){
+    __m128 left[BlockGrid::blockSize], right[BlockGrid::blockSize];
+    for (size_t row = 0 ; row < BlockGrid::blockSize ; ++row){
+        // Sign-extend 8 samples to 32 bits
+        __m128i const samples = _mm_loadl_epi64(reinterpret_cast<__m128i const*>(input + row * BlockGrid::blockSize));
+        __m128i const samples16 = _mm_srai_epi16(_mm_unpacklo_epi8(samples, samples), 8);
+        left[row] = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(samples16, samples16), 16));
+        right[row] = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(samples16, samples16), 16));
+    }
+    // Row transforms, performed on columns of the transposed block
+    transposeSSE2(left, right);
+    applyAAN1DTransform(left);
+    applyAAN1DTransform(right);
+    transposeSSE2(left, right);
+    // Column transforms
+    applyAAN1DTransform(left);
+    applyAAN1DTransform(right);
+    for (size_t row = 0 ; row < BlockGrid::blockSize ; ++row){
+        _mm_storeu_ps(output + row * BlockGrid::blockSize, left[row]);
+        _mm_storeu_ps(output + row * BlockGrid::blockSize + 4, right[row]);
+    }
+}
+
+[[gnu::target("sse2")]] void jpeg::AANDiscreteCosineTransformer::applyInverseTransformSSE2(float const* input, int8_t* output){
+    __m128 left[BlockGrid::blockSize], right[BlockGrid::blockSize];
+    for (size_t row = 0 ; row < BlockGrid::blockSize ; ++row){
+        left[row] = _mm_loadu_ps(input + row * BlockGrid::blockSize);
+        right[row] = _mm_loadu_ps(input + row * BlockGrid::blockSize + 4);
+    }
+    // Column transforms
+    applyAAN1DInverseTransform(left);
+    applyAAN1DInverseTransform(right);
+    // Row transforms, performed on columns of the transposed block
+    transposeSSE2(left, right);
+    applyAAN1DInverseTransform(left);
+    applyAAN1DInverseTransform(right);
+    transposeSSE2(left, right);
+    for (size_t row = 0 ; row < BlockGrid::blockSize ; ++row){
+        // Clamp to the range of int8_t, then truncate as the scalar conversion does
+        __m128i const leftSamples = _mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(left[row], _mm_set1_ps(127.0f)), _mm_set1_ps(-128.0f)));
+        __m128i const rightSamples = _mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(right[row], _mm_set1_ps(127.0f)), _mm_set1_ps(-128.0f)));
+        __m128i const samples16 = _mm_packs_epi32(leftSamples, rightSamples);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(output + row * BlockGrid::blockSize), _mm_packs_epi16(samples16, samples16));
+    }
+}
+
+[[gnu::target("avx2")]] void jpeg::AANDiscreteCosineTransformer::applyTransformAVX2(int8_t const* input, float* output){
+    __m256 rows[BlockGrid::blockSize];
+    for (size_t row = 0 ; row < BlockGrid::blockSize ; ++row){
+        __m128i const samples = _mm_loadl_epi64(reinterpret_cast<__m128i const*>(input + row * BlockGrid::blockSize));
+        rows[row] = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(samples));
+    }
+    // Row transforms, performed on columns of the transposed block
+    transposeAVX2(rows);
+    applyAAN1DTransform(rows);
+    transposeAVX2(rows);
+    // Column transforms
+    applyAAN1DTransform(rows);
+    for (size_t row = 0 ; row < BlockGrid::blockSize ; ++row){
+        _mm256_storeu_ps(output + row * BlockGrid::blockSize, rows[row]);
+    }
+}
+
+[[gnu::target("avx2")]] void jpeg::AANDiscreteCosineTransformer::applyInverseTransformAVX2(float const* input, int8_t* output){
+    __m256 rows[BlockGrid::blockSize];
+    for (size_t row = 0 ; row < BlockGrid::blockSize ; ++row){
+        rows[row] = _mm256_loadu_ps(input + row * BlockGrid::blockSize);
+    }
+    // Column transforms
+    applyAAN1DInverseTransform(rows);
+    // Row transforms, performed on columns of the transposed block
+    transposeAVX2(rows);
+    applyAAN1DInverseTransform(rows);
+    transposeAVX2(rows);
+    for (size_t row = 0 ; row < BlockGrid::blockSize ; ++row){
+        // Clamp to the range of int8_t, then truncate as the scalar conversion does
+        __m256i const samples = _mm256_cvttps_epi32(_mm256_max_ps(_mm256_min_ps(rows[row], _mm256_set1_ps(127.0f)), _mm256_set1_ps(-128.0f)));
+        __m128i const samples16 = _mm_packs_epi32(_mm256_castsi256_si128(samples), _mm256_extracti128_si256(samples, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(output + row * BlockGrid::blockSize), _mm_packs_epi16(samples16, samples16));
+    }
+}
+
+#endif
@@ -1,6 +1,17 @@
 
 #include "encoder.hpp"
 
+namespace{
+    /* Reads the length of a segment (following its marker), checking that the payload it gives lies within the stream */
+    uint16_t readSegmentLength(jpeg::BitStream const& inputStream, jpeg::BitStreamReadProgress& readProgress, std::string const& segmentName){
+        auto const startOfPayload = readProgress.currentByte;
+        uint16_t const length = inputStream.readNextAlignedWord(readProgress);
+        if (startOfPayload + length > inputStream.getSize()){
+            throw std::runtime_error(segmentName + " length parameter exceeds size of input JPEG data");
+        }
+        return length;
+    }
+}
 
 jpeg::Encoder::Encoder(std::unique_ptr<ColourMapper> colourMapper,
                                      std::unique_ptr<DiscreteCosineTransformer> discreteCosineTransformer,
@@ -9,58 +20,451 @@ jpeg::Encoder::Encoder(std::unique_ptr<ColourMapper> colourMapper,
                                                                                        m_discreteCosineTransformer{std::move(discreteCosineTransformer)},
                                                                                        m_quantiser{std::move(quantiser)},
                                                                                        m_entropyEncoder{std::move(entropyEncoder)}{
+    m_quantiser->applyTransformScaling(*m_discreteCosineTransformer);
+}
+
+void jpeg::Encoder::encode(BitmapImageRGB const& inputImage, JPEGImage& outputImage, EncodeOptions const& options){
+    encode(ImageView(inputImage), outputImage, options);
 }
 
-void jpeg::Encoder::encode(BitmapImageRGB const& inputImage, JPEGImage& outputImage){
+/* Encodes directly from the viewed pixel data, without copying it */
+void jpeg::Encoder::encode(ImageView const& inputImage, JPEGImage& outputImage, EncodeOptions const& options){
     try{
-        outputImage.m_compressedImageData.clearStream();
-        encodeHeader(inputImage, outputImage.m_compressedImageData, m_quantiser, m_entropyEncoder);
-        size_t startOfScanData = outputImage.m_compressedImageData.getSize();
+        validateOptions(options);
+        encodeWholeImage(inputImage, outputImage, options);
+    }
+    catch(std::exception const& e){
+        std::cout << "[Error]: " << e.what() << "\n";
+    }
+}
+
+/* Rejects combinations of options that no encoding path supports, before any of the image is processed */
+void jpeg::Encoder::validateOptions(EncodeOptions const& options){
+    if (options.m_progressive && options.m_arithmeticCoding){
+        throw std::runtime_error("Progressive encoding with arithmetic coding (SOF10) is not supported");
+    }
+}
+
+/* Encodes into a JPEGImage, letting any error propagate to the caller */
+void jpeg::Encoder::encodeWholeImage(ImageView const& inputImage, JPEGImage& outputImage, EncodeOptions const& options) const{
+    InputBlockGrid blockGrid(inputImage);
+    uint16_t const restartInterval = getRestartInterval(blockGrid, options);
+    if (options.m_progressive){
+        std::vector<QuantisedBlock> const blocks = quantiseBlocks(transformBlocks(blockGrid, options), blockGrid.getNumBlockCols(), *m_quantiser, options);
+        encodeProgressiveImage(inputImage.m_width, inputImage.m_height, blockGrid.getNumBlockCols(), blocks, *m_quantiser, restartInterval, options, outputImage);
+    }
+    else if (options.m_arithmeticCoding){
+        std::vector<QuantisedBlock> const blocks = quantiseBlocks(transformBlocks(blockGrid, options), blockGrid.getNumBlockCols(), *m_quantiser, options);
+        encodeArithmeticImage(inputImage.m_width, inputImage.m_height, blockGrid.getNumBlockCols(), blocks, *m_quantiser, restartInterval, options, outputImage);
+    }
+    else if (options.m_optimiseHuffmanTables){
+        std::vector<QuantisedBlock> const blocks = quantiseBlocks(transformBlocks(blockGrid, options), blockGrid.getNumBlockCols(), *m_quantiser, options);
+        encodeOptimisedImage(inputImage.m_width, inputImage.m_height, blockGrid.getNumBlockCols(), blocks, *m_quantiser, restartInterval, options, outputImage);
+    }
+    else{
+        encodeImage(inputImage.m_width, inputImage.m_height, blockGrid.getNumBlockRows(), *m_quantiser, *m_entropyEncoder, restartInterval, options, getStripEncoder(blockGrid, options), outputImage);
+    }
+}
+
+int jpeg::Encoder::encodeToSize(BitmapImageRGB const& inputImage, JPEGImage& outputImage, size_t targetFileSize, EncodeOptions const& options){
+    return encodeToSize(ImageView(inputImage), outputImage, targetFileSize, options);
+}
+
+/* Encodes at the highest quality whose output fits within the target file size (in bytes), found by bisection on 
+   the assumption that the file size grows with quality. The image is colour mapped and transformed only once, and 
+   the cached coefficients are quantised and entropy-coded again at each quality tried. Returns the quality used,
+   or 0 if even the lowest quality does not fit (in which case the output is left unchanged). */
+int jpeg::Encoder::encodeToSize(ImageView const& inputImage, JPEGImage& outputImage, size_t targetFileSize, EncodeOptions const& options){
+    try{
+        validateOptions(options);
         InputBlockGrid blockGrid(inputImage);
-        std::array<int16_t, 3> lastDCValues = {0,0,0};
-        for (auto const& block : blockGrid){
-            ColourMappedBlockData colourMappedBlock = m_colourMapper->map(block);
+        uint16_t const restartInterval = getRestartInterval(blockGrid, options);
+        size_t const numBlockRows = blockGrid.getNumBlockRows();
+        size_t const numBlockCols = blockGrid.getNumBlockCols();
+        std::vector<TransformedBlock> const coefficients = transformBlocks(blockGrid, options);
+
+        int bestQuality = 0;
+        int lowestQuality = 1, highestQuality = 100;
+        JPEGImage candidateImage;
+        while (lowestQuality <= highestQuality){
+            int const quality = (lowestQuality + highestQuality) / 2;
+            Quantiser quantiser(quality, m_quantiser->getSimdLevel());
+            quantiser.applyTransformScaling(*m_discreteCosineTransformer);
+            if (options.m_progressive){
+                std::vector<QuantisedBlock> const blocks = quantiseBlocks(coefficients, numBlockCols, quantiser, options);
+                encodeProgressiveImage(inputImage.m_width, inputImage.m_height, numBlockCols, blocks, quantiser, restartInterval, options, candidateImage);
+            }
+            else if (options.m_arithmeticCoding){
+                std::vector<QuantisedBlock> const blocks = quantiseBlocks(coefficients, numBlockCols, quantiser, options);
+                encodeArithmeticImage(inputImage.m_width, inputImage.m_height, numBlockCols, blocks, quantiser, restartInterval, options, candidateImage);
+            }
+            else if (options.m_optimiseHuffmanTables){
+                std::vector<QuantisedBlock> const blocks = quantiseBlocks(coefficients, numBlockCols, quantiser, options);
+                encodeOptimisedImage(inputImage.m_width, inputImage.m_height, numBlockCols, blocks, quantiser, restartInterval, options, candidateImage);
+            }
+            else{
+                auto encodeStrip = [&](size_t firstBlockRow, size_t lastBlockRow, std::array<int16_t, 3>& lastDCValues, BitStream& outputStream){
+                    for (size_t blockIndex = firstBlockRow * numBlockCols ; blockIndex < lastBlockRow * numBlockCols ; ++blockIndex){
+                        for (size_t channel = 0 ; channel < 3 ; ++channel){
+                            encodeBlockChannel(coefficients[blockIndex][channel], m_colourMapper->isLuminanceComponent(channel), quantiser, lastDCValues[channel], outputStream, options.m_trellisQuantisation);
+                        }
+                    }
+                };
+                encodeImage(inputImage.m_width, inputImage.m_height, numBlockRows, quantiser, *m_entropyEncoder, restartInterval, options, encodeStrip, candidateImage);
+            }
+            if (candidateImage.m_fileSize <= targetFileSize){
+                bestQuality = quality;
+                std::swap(outputImage, candidateImage);
+                lowestQuality = quality + 1;
+            }
+            else{
+                highestQuality = quality - 1;
+            }
+        }
+        return bestQuality;
+    }
+    catch(std::exception const& e){
+        std::cout << "[Error]: " << e.what() << "\n";
+    }
+    return 0;
+}
+
+/* Transforms every block of the image, distributing block-rows between the workers */
+std::vector<jpeg::Encoder::TransformedBlock> jpeg::Encoder::transformBlocks(InputBlockGrid const& blockGrid, EncodeOptions const& options) const{
+    size_t const numBlockRows = blockGrid.getNumBlockRows();
+    size_t const numBlockCols = blockGrid.getNumBlockCols();
+    std::vector<TransformedBlock> coefficients(numBlockRows * numBlockCols);
+    WorkerPool workerPool(std::clamp<size_t>(options.m_numThreads, 1, std::max<size_t>(numBlockRows, 1)));
+    workerPool.run(numBlockRows, [&](size_t blockRow, size_t /* worker */){
+        auto block = blockGrid.beginBlockRow(blockRow);
+        for (size_t blockIndex = blockRow * numBlockCols ; blockIndex < (blockRow + 1) * numBlockCols ; ++blockIndex, ++block){
+            ColourMappedBlockData colourMappedBlock = m_colourMapper->map(*block);
             for (size_t channel = 0 ; channel < 3 ; ++channel){
-                DctBlockChannelData dctData = m_discreteCosineTransformer->transform(colourMappedBlock.m_data[channel]);
-                QuantisedBlockChannelData quantisedData = m_quantiser->quantise(dctData, m_colourMapper->isLuminanceComponent(channel));
-                m_entropyEncoder->encode(quantisedData, lastDCValues[channel], outputImage.m_compressedImageData, m_colourMapper->isLuminanceComponent(channel));
+                coefficients[blockIndex][channel] = m_discreteCosineTransformer->transform(colourMappedBlock.m_data[channel]);
             }
         }
-        outputImage.m_compressedImageData.stuffBytes(startOfScanData);
-        // Push end of image marker
-        outputImage.m_compressedImageData.pushIntoAlignment();
-        outputImage.m_compressedImageData.pushWord(markerEndOfImageSegmentEOI);
+    });
+    return coefficients;
+}
+
+/* Quantises every transformed block, distributing block-rows between the workers */
+std::vector<jpeg::Encoder::QuantisedBlock> jpeg::Encoder::quantiseBlocks(std::vector<TransformedBlock> const& coefficients, size_t numBlockCols, Quantiser const& quantiser, EncodeOptions const& options) const{
+    size_t const numBlockRows = numBlockCols == 0 ? 0 : coefficients.size() / numBlockCols;
+    std::vector<QuantisedBlock> blocks(coefficients.size());
+    WorkerPool workerPool(std::clamp<size_t>(options.m_numThreads, 1, std::max<size_t>(numBlockRows, 1)));
+    workerPool.run(numBlockRows, [&](size_t blockRow, size_t /* worker */){
+        for (size_t blockIndex = blockRow * numBlockCols ; blockIndex < (blockRow + 1) * numBlockCols ; ++blockIndex){
+            for (size_t channel = 0 ; channel < 3 ; ++channel){
+                blocks[blockIndex][channel] = quantiseBlockChannel(coefficients[blockIndex][channel], m_colourMapper->isLuminanceComponent(channel), quantiser, options.m_trellisQuantisation);
+            }
+        }
+    });
+    return blocks;
+}
 
-        outputImage.m_width = inputImage.m_width;// to remove
-        outputImage.m_height = inputImage.height; // to remove
-        outputImage.m_fileSize = outputImage.m_compressedImageData.getSize();
-        outputImage.m_supportsSaving = supportsSaving();
+/* Writes a complete JPEG of already quantised blocks, with Huffman tables built for the symbols that they contain.
+   Symbols are counted with the same DC predictions as the entropy coder, which restarts them at each interval. */
+void jpeg::Encoder::encodeOptimisedImage(uint16_t width, uint16_t height, size_t numBlockCols, std::vector<QuantisedBlock> const& blocks, Quantiser const& quantiser, uint16_t restartInterval, EncodeOptions const& options, JPEGImage& outputImage) const{
+    SymbolFrequencies frequencies;
+    std::array<int16_t, 3> lastDCValues = {0,0,0};
+    for (size_t blockIndex = 0 ; blockIndex < blocks.size() ; ++blockIndex){
+        if (restartInterval != 0 && blockIndex % restartInterval == 0){
+            lastDCValues = {0,0,0};
+        }
+        for (size_t channel = 0 ; channel < 3 ; ++channel){
+            m_entropyEncoder->countSymbols(blocks[blockIndex][channel], lastDCValues[channel], frequencies, m_colourMapper->isLuminanceComponent(channel));
+        }
+    }
+    HuffmanEncoder const entropyEncoder(frequencies, quantiser.getSimdLevel());
+    auto encodeStrip = [&](size_t firstBlockRow, size_t lastBlockRow, std::array<int16_t, 3>& lastDCValues, BitStream& outputStream){
+        for (size_t blockIndex = firstBlockRow * numBlockCols ; blockIndex < lastBlockRow * numBlockCols ; ++blockIndex){
+            for (size_t channel = 0 ; channel < 3 ; ++channel){
+                entropyEncoder.encode(blocks[blockIndex][channel], lastDCValues[channel], outputStream, m_colourMapper->isLuminanceComponent(channel));
+            }
+        }
+    };
+    size_t const numBlockRows = numBlockCols == 0 ? 0 : blocks.size() / numBlockCols;
+    encodeImage(width, height, numBlockRows, quantiser, entropyEncoder, restartInterval, options, encodeStrip, outputImage);
+}
+
+/* Writes a complete arithmetic-coded JPEG of already quantised blocks. Each strip is coded by its own interval 
+   encoder, since the statistics of the coder (like the DC predictions) restart at each interval. */
+void jpeg::Encoder::encodeArithmeticImage(uint16_t width, uint16_t height, size_t numBlockCols, std::vector<QuantisedBlock> const& blocks, Quantiser const& quantiser, uint16_t restartInterval, EncodeOptions const& options, JPEGImage& outputImage) const{
+    ArithmeticEncoder const entropyEncoder;
+    auto encodeStrip = [&](size_t firstBlockRow, size_t lastBlockRow, std::array<int16_t, 3>& /* lastDCValues */, BitStream& outputStream){
+        ArithmeticEncoder::IntervalEncoder intervalEncoder(entropyEncoder, outputStream);
+        for (size_t blockIndex = firstBlockRow * numBlockCols ; blockIndex < lastBlockRow * numBlockCols ; ++blockIndex){
+            for (size_t channel = 0 ; channel < 3 ; ++channel){
+                intervalEncoder.encode(blocks[blockIndex][channel], channel, m_colourMapper->isLuminanceComponent(channel));
+            }
+        }
+        intervalEncoder.finish();
+    };
+    size_t const numBlockRows = numBlockCols == 0 ? 0 : blocks.size() / numBlockCols;
+    encodeImage(width, height, numBlockRows, quantiser, entropyEncoder, restartInterval, options, encodeStrip, outputImage);
+}
+
+/* Writes a complete progressive JPEG of already quantised blocks, coding each of the standard scans in turn. The
+   symbols of each scan are counted in a first pass over its intervals, for the tables it is then coded with. Each
+   strip of a scan is coded by its own interval encoder, since runs of blocks ending in an EOB (like the DC 
+   predictions) restart at each interval. */
+void jpeg::Encoder::encodeProgressiveImage(uint16_t width, uint16_t height, size_t numBlockCols, std::vector<QuantisedBlock> const& blocks, Quantiser const& quantiser, uint16_t restartInterval, EncodeOptions const& options, JPEGImage& outputImage) const{
+    size_t const numBlockRows = numBlockCols == 0 ? 0 : blocks.size() / numBlockCols;
+    size_t const stripHeight = restartInterval == 0 ? std::max<size_t>(numBlockRows, 1) : options.m_restartIntervalBlockRows;
+    BitStream& outputStream = outputImage.m_compressedImageData;
+    outputStream.clearStream();
+    outputStream.reserve(size_t(width) * height / 4);
+    encodeFrameHeader(width, height, outputStream, quantiser, markerStartOfFrame2SOF2);
+    encodeRestartIntervalDefinition(outputStream, restartInterval);
+    for (ScanParameters const& scan : ProgressiveHuffmanEncoder::standardScans){
+        SymbolFrequencies frequencies;
+        for (size_t firstBlockRow = 0 ; firstBlockRow < numBlockRows ; firstBlockRow += stripHeight){
+            ProgressiveHuffmanEncoder::IntervalEncoder intervalEncoder(scan, frequencies);
+            for (size_t blockIndex = firstBlockRow * numBlockCols ; blockIndex < std::min(numBlockRows, firstBlockRow + stripHeight) * numBlockCols ; ++blockIndex){
+                for (size_t channel = 0 ; channel < 3 ; ++channel){
+                    if (scan.includesComponent(channel)){
+                        intervalEncoder.encode(blocks[blockIndex][channel], channel, m_colourMapper->isLuminanceComponent(channel));
+                    }
+                }
+            }
+            intervalEncoder.finish();
+        }
+        ProgressiveHuffmanEncoder const entropyEncoder(scan, frequencies);
+        auto encodeStrip = [&](size_t firstBlockRow, size_t lastBlockRow, std::array<int16_t, 3>& /* lastDCValues */, BitStream& stripStream){
+            ProgressiveHuffmanEncoder::IntervalEncoder intervalEncoder(entropyEncoder, stripStream);
+            for (size_t blockIndex = firstBlockRow * numBlockCols ; blockIndex < lastBlockRow * numBlockCols ; ++blockIndex){
+                for (size_t channel = 0 ; channel < 3 ; ++channel){
+                    if (scan.includesComponent(channel)){
+                        intervalEncoder.encode(blocks[blockIndex][channel], channel, m_colourMapper->isLuminanceComponent(channel));
+                    }
+                }
+            }
+            intervalEncoder.finish();
+        };
+        entropyEncoder.encodeHeaderEntropyTables(outputStream);
+        encodeScanHeader(outputStream, scan);
+        encodeScan(numBlockRows, restartInterval, options, encodeStrip, outputStream);
+    }
+    // Push end of image marker
+    outputStream.pushWord(markerEndOfImageSegmentEOI);
+
+    outputImage.m_width = width;
+    outputImage.m_height = height;
+    outputImage.m_fileSize = outputStream.getSize();
+    outputImage.m_supportsSaving = supportsSaving();
+}
+
+/* Writes a complete JPEG, entropy-coding its block-rows with the given strip encoder */
+void jpeg::Encoder::encodeImage(uint16_t width, uint16_t height, size_t numBlockRows, Quantiser const& quantiser, EntropyHeaderEncoder const& entropyEncoder, uint16_t restartInterval, EncodeOptions const& options, StripEncoder const& encodeStrip, JPEGImage& outputImage) const{
+    outputImage.m_compressedImageData.clearStream();
+    // Typical photographs compress to under 2 bits per pixel
+    outputImage.m_compressedImageData.reserve(size_t(width) * height / 4);
+    encodeHeader(width, height, outputImage.m_compressedImageData, quantiser, entropyEncoder, restartInterval);
+    encodeScan(numBlockRows, restartInterval, options, encodeStrip, outputImage.m_compressedImageData);
+    // Push end of image marker
+    outputImage.m_compressedImageData.pushWord(markerEndOfImageSegmentEOI);
+
+    outputImage.m_width = width;// to remove
+    outputImage.m_height = height; // to remove
+    outputImage.m_fileSize = outputImage.m_compressedImageData.getSize();
+    outputImage.m_supportsSaving = supportsSaving();
+}
+
+/* Entropy-codes the block-rows of a scan with the given strip encoder, as a single interval or as strips separated by
+   restart markers */
+void jpeg::Encoder::encodeScan(size_t numBlockRows, uint16_t restartInterval, EncodeOptions const& options, StripEncoder const& encodeStrip, BitStream& outputStream) const{
+    if (restartInterval == 0){
+        std::array<int16_t, 3> lastDCValues = {0,0,0};
+        outputStream.setByteStuffing(true);
+        encodeStrip(0, numBlockRows, lastDCValues, outputStream);
+        outputStream.pushIntoAlignment();
+        outputStream.setByteStuffing(false);
+    }
+    else{
+        encodeRestartStrips(numBlockRows, options, encodeStrip, outputStream);
+    }
+}
+
+/* Encodes straight into a sink. The output is identical to that of encoding into a JPEGImage, but is written 
+   one block-row (or one batch of restart intervals) at a time, so it is never held in memory in full. The exception
+   is when Huffman tables are optimised, arithmetic coding is used or the image is progressive, since these code the
+   quantised whole image. */
+void jpeg::Encoder::encode(ImageView const& inputImage, OutputSink& outputSink, EncodeOptions const& options){
+    try{
+        validateOptions(options);
+        if (options.m_optimiseHuffmanTables || options.m_arithmeticCoding || options.m_progressive){
+            // Nothing is written to the sink if encoding fails
+            JPEGImage outputImage;
+            encodeWholeImage(inputImage, outputImage, options);
+            outputImage.m_compressedImageData.flushCompleteBytes(outputSink);
+            outputSink.flush();
+            return;
+        }
+        BitStream outputStream;
+        InputBlockGrid blockGrid(inputImage);
+        uint16_t const restartInterval = getRestartInterval(blockGrid, options);
+        encodeHeader(inputImage.m_width, inputImage.m_height, outputStream, *m_quantiser, *m_entropyEncoder, restartInterval);
+        outputStream.flushCompleteBytes(outputSink);
+        if (restartInterval == 0){
+            std::array<int16_t, 3> lastDCValues = {0,0,0};
+            outputStream.setByteStuffing(true);
+            for (uint16_t blockRow = 0 ; blockRow < blockGrid.getNumBlockRows() ; ++blockRow){
+                encodeBlocks(blockGrid.beginBlockRow(blockRow), blockGrid.beginBlockRow(blockRow + 1), lastDCValues, outputStream, options.m_trellisQuantisation);
+                // Only complete bytes are flushed - the partially filled byte is carried into the next block-row
+                outputStream.flushCompleteBytes(outputSink);
+            }
+            outputStream.pushIntoAlignment();
+            outputStream.setByteStuffing(false);
+        }
+        else{
+            encodeRestartStrips(blockGrid.getNumBlockRows(), options, getStripEncoder(blockGrid, options), outputStream, &outputSink);
+        }
+        // Push end of image marker
+        outputStream.pushWord(markerEndOfImageSegmentEOI);
+        outputStream.flushCompleteBytes(outputSink);
+        outputSink.flush();
     }
     catch(std::exception const& e){
         std::cout << "[Error]: " << e.what() << "\n";
     }
 }
 
-void jpeg::Encoder::decode(JPEGImage inputImage, BitmapImageRGB& outputImage){
+/* Converts the restart interval from block-rows to MCUs */
+uint16_t jpeg::Encoder::getRestartInterval(InputBlockGrid const& blockGrid, EncodeOptions const& options) const{
+    size_t const restartInterval = size_t(options.m_restartIntervalBlockRows) * blockGrid.getNumBlockCols();
+    if (restartInterval > 0xFFFF){
+        throw std::runtime_error("Restart interval exceeds the maximum of 65535 MCUs - try using shorter strips");
+    }
+    return restartInterval;
+}
+
+/* Entropy-codes a contiguous range of blocks, updating the DC predictor of each channel */
+void jpeg::Encoder::encodeBlocks(InputBlockGrid::BlockIterator first, InputBlockGrid::BlockIterator last, std::array<int16_t, 3>& lastDCValues, BitStream& outputStream, bool trellisQuantisation) const{
+    for (auto block = first ; block != last ; ++block){
+        ColourMappedBlockData colourMappedBlock = m_colourMapper->map(*block);
+        for (size_t channel = 0 ; channel < 3 ; ++channel){
+            DctBlockChannelData dctData = m_discreteCosineTransformer->transform(colourMappedBlock.m_data[channel]);
+            encodeBlockChannel(dctData, m_colourMapper->isLuminanceComponent(channel), *m_quantiser, lastDCValues[channel], outputStream, trellisQuantisation);
+        }
+    }
+}
+
+/* Quantises and entropy-codes the transformed coefficients of one channel of a block. Unless trellis quantisation
+   is enabled, the block is quantised straight into the zig-zag order that the entropy encoder takes. */
+void jpeg::Encoder::encodeBlockChannel(DctBlockChannelData const& dctData, bool isLuminance, Quantiser const& quantiser, int16_t& lastDCValue, BitStream& outputStream, bool trellisQuantisation) const{
+    if (!trellisQuantisation){
+        m_entropyEncoder->encodeZigZag(quantiser.quantiseToZigZag(dctData, isLuminance), lastDCValue, outputStream, isLuminance);
+        return;
+    }
+    m_entropyEncoder->encode(quantiseBlockChannel(dctData, isLuminance, quantiser, trellisQuantisation), lastDCValue, outputStream, isLuminance);
+}
+
+/* Quantises the transformed coefficients of one channel of a block, optimising them for the default tables if
+   trellis quantisation is enabled */
+jpeg::QuantisedBlockChannelData jpeg::Encoder::quantiseBlockChannel(DctBlockChannelData const& dctData, bool isLuminance, Quantiser const& quantiser, bool trellisQuantisation) const{
+    QuantisedBlockChannelData quantisedData = quantiser.quantise(dctData, isLuminance);
+    if (trellisQuantisation){
+        quantisedData = m_entropyEncoder->optimiseQuantisation(quantisedData, quantiser.getQuotients(dctData, isLuminance), quantiser.getStepSizes(isLuminance), isLuminance);
+    }
+    return quantisedData;
+}
+
+/* Encodes the block-rows of each strip straight from the image */
+jpeg::Encoder::StripEncoder jpeg::Encoder::getStripEncoder(InputBlockGrid const& blockGrid, EncodeOptions const& options) const{
+    return [this, &blockGrid, trellisQuantisation = options.m_trellisQuantisation](size_t firstBlockRow, size_t lastBlockRow, std::array<int16_t, 3>& lastDCValues, BitStream& outputStream){
+        encodeBlocks(blockGrid.beginBlockRow(firstBlockRow), blockGrid.beginBlockRow(lastBlockRow), lastDCValues, outputStream, trellisQuantisation);
+    };
+}
+
+/* Encodes each strip of the image into its own (byte-stuffed) stream, then joins the strips with restart markers.
+   If a sink is given, strips are encoded in batches of a few per worker, and each batch is flushed to the sink 
+   before the next is encoded, bounding memory use. */
+void jpeg::Encoder::encodeRestartStrips(size_t numBlockRows, EncodeOptions const& options, StripEncoder const& encodeStrip, BitStream& outputStream, OutputSink* outputSink) const{
+    size_t const stripHeight = options.m_restartIntervalBlockRows;
+    size_t const numStrips = (numBlockRows + stripHeight - 1) / stripHeight;
+    WorkerPool workerPool(std::clamp<size_t>(options.m_numThreads, 1, numStrips));
+    size_t const stripsPerBatch = outputSink ? 4 * workerPool.getNumWorkers() : numStrips;
+    std::vector<BitStream> strips(std::min(stripsPerBatch, numStrips));
+    for (size_t firstStrip = 0 ; firstStrip < numStrips ; firstStrip += stripsPerBatch){
+        size_t const numStripsInBatch = std::min(stripsPerBatch, numStrips - firstStrip);
+        workerPool.run(numStripsInBatch, [&](size_t stripInBatch, size_t /* worker */){
+            size_t const strip = firstStrip + stripInBatch;
+            std::array<int16_t, 3> lastDCValues = {0,0,0};
+            strips[stripInBatch].clearStream();
+            strips[stripInBatch].setByteStuffing(true);
+            encodeStrip(strip * stripHeight, std::min(numBlockRows, (strip + 1) * stripHeight), lastDCValues, strips[stripInBatch]);
+            strips[stripInBatch].pushIntoAlignment();
+        });
+        for (size_t stripInBatch = 0 ; stripInBatch < numStripsInBatch ; ++stripInBatch){
+            size_t const strip = firstStrip + stripInBatch;
+            outputStream.append(strips[stripInBatch]);
+            if (strip + 1 < numStrips){
+                outputStream.pushWord(markerRestartIntervalRST0 + strip % 8);
+            }
+        }
+        if (outputSink){
+            outputStream.flushCompleteBytes(*outputSink);
+        }
+    }
+}
+
+/* Decodes the entropy-coded data in place, without modifying or copying the compressed image */
+void jpeg::Encoder::decode(JPEGImage const& inputImage, BitmapImageRGB& outputImage, DecodeOptions const& options){
     try{
-        OutputBlockGrid outputBlockGrid(inputImage.m_width, inputImage.m_height);
+        if (options.m_scaleDenominator == 0 || BlockGrid::blockSize % options.m_scaleDenominator != 0){
+            throw std::runtime_error("Decoding scale denominator must be 1, 2, 4 or 8");
+        }
+        BitStream const& inputStream = inputImage.m_compressedImageData;
         BitStreamReadProgress readProgress{};
-        decodeHeader(inputImage.m_compressedImageData, readProgress, outputImage);
-        inputImage.m_compressedImageData.removeStuffedBytes(readProgress);
-        // Decode image block-by-block
-        std::array<int16_t, 3> lastDCValues = {0,0,0};
-        while (!outputBlockGrid.atEnd()){
-            ColourMappedBlockData thisBlock;
-            for (size_t channel = 0 ; channel < 3 ; ++channel){
-                QuantisedBlockChannelData quantisedData = m_entropyEncoder->decode(inputImage.m_compressedImageData, readProgress, lastDCValues[channel], m_colourMapper->isLuminanceComponent(channel));
-                DctBlockChannelData dctData = m_quantiser->dequantise(quantisedData, m_colourMapper->isLuminanceComponent(channel));
-                ColourMappedBlockData::BlockChannelData colourMappedChannelData = m_discreteCosineTransformer->inverseTransform(dctData);
-                thisBlock.m_data[channel] = colourMappedChannelData;
+        uint16_t restartInterval = 0;
+        BitmapImageRGB imageDimensions;
+        std::shared_ptr<DecodingTables const> const tables = decodeHeader(inputStream, readProgress, imageDimensions, restartInterval);
+        OutputBlockGrid outputBlockGrid(imageDimensions.m_width, imageDimensions.height, options.m_scaleDenominator);
+        std::vector<size_t> const restartMarkerPositions = inputStream.findRestartMarkers(readProgress.currentByte);
+
+        // Locate the start of each restart interval (the whole image forms a single interval if there are none)
+        size_t const numBlocks = outputBlockGrid.getNumBlocks();
+        size_t const blocksPerInterval = (restartInterval == 0) ? numBlocks : restartInterval;
+        size_t const numIntervals = (numBlocks + blocksPerInterval - 1) / blocksPerInterval;
+        if (restartMarkerPositions.size() + 1 != numIntervals){
+            throw std::runtime_error("Number of RST markers does not correspond to restart interval");
+        }
+        std::vector<size_t> intervalStarts(numIntervals, readProgress.currentByte);
+        for (size_t interval = 1 ; interval < numIntervals ; ++interval){
+            size_t const markerPosition = restartMarkerPositions[interval - 1];
+            if (inputStream.readByte(markerPosition + 1) != uint8_t(markerRestartIntervalRST0 + (interval - 1) % 8)){
+                throw std::runtime_error("RST markers are out of sequence");
             }
-        outputBlockGrid.processNextBlock(m_colourMapper->unmap(thisBlock));
+            intervalStarts[interval] = markerPosition + 2;
         }
+
+        // Decode each interval independently, since each begins with fresh DC predictors (and arithmetic coder statistics)
+        BitStreamReadProgress endOfScanData;
+        WorkerPool workerPool(std::clamp<size_t>(options.m_numThreads, 1, numIntervals));
+        workerPool.run(numIntervals, [&](size_t interval, size_t /* worker */){
+            BitReader intervalReader(inputStream.getBytes(), intervalStarts[interval]);
+            size_t const firstBlock = interval * blocksPerInterval;
+            decodeBlocks(intervalReader, firstBlock, std::min(numBlocks, firstBlock + blocksPerInterval), *tables, outputBlockGrid);
+            if (tables->m_arithmeticEncoder){
+                /* The arithmetic decoder reads ahead of the data it has decoded, and encoders may omit trailing zero 
+                   bytes, so arithmetic-coded intervals are only delimited by their markers */
+                if (interval + 1 == numIntervals){
+                    endOfScanData.currentByte = inputStream.findNextMarker(intervalStarts[interval]);
+                }
+            }
+            else if (interval + 1 < numIntervals){
+                if (inputStream.skipFillBytes(intervalReader.getAlignedPosition()) != restartMarkerPositions[interval]){
+                    throw std::runtime_error("Restart interval does not end at RST marker");
+                }
+            }
+            else{
+                endOfScanData.currentByte = intervalReader.getAlignedPosition();
+            }
+        });
+
         // Check end of image marker
-        if (inputImage.m_compressedImageData.readNextAlignedWord(readProgress) != markerEndOfImageSegmentEOI){
+        endOfScanData.currentByte = inputStream.skipFillBytes(endOfScanData.currentByte);
+        if (endOfScanData.currentByte + 2 > inputStream.getSize() || inputStream.readNextAlignedWord(endOfScanData) != markerEndOfImageSegmentEOI){
             throw std::runtime_error("Failed to find EOI marker");
         }
         outputImage = outputBlockGrid.getBitmapRGB();
@@ -70,8 +474,64 @@ void jpeg::Encoder::decode(JPEGImage inputImage, BitmapImageRGB& outputImage){
     }
 }
 
-/* Issue: currently hardcoded with baseline parameters*/
-void jpeg::Encoder::encodeHeader(BitmapImageRGB const& inputImage, BitStream& outputStream, std::unique_ptr<Quantiser> const& quantiser, std::unique_ptr<EntropyEncoder> const& entropyEncoder) const {
+/* Decodes a contiguous range of blocks, starting from fresh DC predictors */
+void jpeg::Encoder::decodeBlocks(BitReader& inputReader, size_t firstBlock, size_t lastBlock, DecodingTables const& tables, OutputBlockGrid& outputBlockGrid) const{
+    if (tables.m_arithmeticEncoder){
+        ArithmeticEncoder::IntervalDecoder intervalDecoder(*tables.m_arithmeticEncoder, inputReader);
+        for (size_t block = firstBlock ; block < lastBlock ; ++block){
+            outputBlockGrid.processBlock(block, decodeBlock(intervalDecoder, tables, outputBlockGrid.getOutputBlockSize()));
+        }
+        return;
+    }
+    std::array<int16_t, 3> lastDCValues = {0,0,0};
+    for (size_t block = firstBlock ; block < lastBlock ; ++block){
+        outputBlockGrid.processBlock(block, decodeBlock(inputReader, lastDCValues, tables, outputBlockGrid.getOutputBlockSize()));
+    }
+}
+
+/* Decodes the next block in the stream with the tables of its JPEG, updating the DC predictor of each channel. If the
+   output block size is less than blockSize, only that many rows and columns of pixels are decoded, and are stored at
+   the start of the block. */
+jpeg::BlockGrid::Block jpeg::Encoder::decodeBlock(BitReader& inputReader, std::array<int16_t, 3>& lastDCValues, DecodingTables const& tables, uint8_t outputBlockSize) const{
+    QuantisedBlock quantisedBlock;
+    for (size_t channel = 0 ; channel < 3 ; ++channel){
+        quantisedBlock[channel] = tables.m_entropyEncoder->decode(inputReader, lastDCValues[channel], m_colourMapper->isLuminanceComponent(channel));
+    }
+    return reconstructBlock(quantisedBlock, tables, outputBlockSize);
+}
+
+/* Decodes the next block of an arithmetic-coded interval */
+jpeg::BlockGrid::Block jpeg::Encoder::decodeBlock(ArithmeticEncoder::IntervalDecoder& intervalDecoder, DecodingTables const& tables, uint8_t outputBlockSize) const{
+    QuantisedBlock quantisedBlock;
+    for (size_t channel = 0 ; channel < 3 ; ++channel){
+        quantisedBlock[channel] = intervalDecoder.decode(channel, m_colourMapper->isLuminanceComponent(channel));
+    }
+    return reconstructBlock(quantisedBlock, tables, outputBlockSize);
+}
+
+/* Dequantises, inverse transforms and unmaps the channels of a decoded block */
+jpeg::BlockGrid::Block jpeg::Encoder::reconstructBlock(QuantisedBlock const& quantisedBlock, DecodingTables const& tables, uint8_t outputBlockSize) const{
+    ColourMappedBlockData thisBlock;
+    for (size_t channel = 0 ; channel < 3 ; ++channel){
+        DctBlockChannelData dctData = tables.m_quantiser->dequantise(quantisedBlock[channel], m_colourMapper->isLuminanceComponent(channel));
+        thisBlock.m_data[channel] = m_discreteCosineTransformer->inverseTransform(dctData, outputBlockSize);
+    }
+    return m_colourMapper->unmap(thisBlock);
+}
+
+/* Writes the header of a sequential JPEG, up to and including the header of its single scan */
+void jpeg::Encoder::encodeHeader(uint16_t width, uint16_t height, BitStream& outputStream, Quantiser const& quantiser, EntropyHeaderEncoder const& entropyEncoder, uint16_t restartInterval){
+    encodeFrameHeader(width, height, outputStream, quantiser, entropyEncoder.getStartOfFrameMarker());
+
+    // DHT (or DAC for arithmetic coding)
+    entropyEncoder.encodeHeaderEntropyTables(outputStream);
+
+    encodeRestartIntervalDefinition(outputStream, restartInterval);
+    encodeScanHeader(outputStream, ScanParameters{});
+}
+
+/* Writes the segments up to and including the frame header */
+void jpeg::Encoder::encodeFrameHeader(uint16_t width, uint16_t height, BitStream& outputStream, Quantiser const& quantiser, uint16_t startOfFrameMarker){
     // SOI
     outputStream.pushWord(markerStartOfImageSegmentSOI);
 
@@ -93,14 +553,14 @@ void jpeg::Encoder::encodeHeader(BitmapImageRGB const& inputImage, BitStream& ou
     /* To implement */
 
     // DQT
-    quantiser->encodeHeaderQuantisationTables(outputStream);
+    quantiser.encodeHeaderQuantisationTables(outputStream);
 
-    // SOF0
-    outputStream.pushWord(markerStartOfFrame0SOF0);
+    // SOF0 (or SOF9 for arithmetic coding, or SOF2 for progressive encoding)
+    outputStream.pushWord(startOfFrameMarker);
     outputStream.pushWord(17); // length
     outputStream.pushByte(0x08); // precision
-    outputStream.pushWord(inputImage.height);
-    outputStream.pushWord(inputImage.m_width);
+    outputStream.pushWord(height);
+    outputStream.pushWord(width);
     outputStream.pushByte(3); // Number of components
     // First component
     outputStream.pushByte(1); // ID
@@ -114,170 +574,237 @@ void jpeg::Encoder::encodeHeader(BitmapImageRGB const& inputImage, BitStream& ou
     outputStream.pushByte(3); // ID
     outputStream.pushByte(0x11); // Horizontal and vertical sampling factor
     outputStream.pushByte(1); // Quantisation table
+}
+
+void jpeg::Encoder::encodeRestartIntervalDefinition(BitStream& outputStream, uint16_t restartInterval){
+    // DRI
+    if (restartInterval > 0){
+        outputStream.pushWord(markerDefineRestartIntervalSegmentDRI);
+        outputStream.pushWord(4); // length
+        outputStream.pushWord(restartInterval); // MCUs per restart interval
+    }
+}
 
-    // DHT
-    entropyEncoder->encodeHeaderEntropyTables(outputStream);
+/* Writes the header of a scan. The luminance component uses tables 0 and the chrominance components tables 1, but
+   as in libjpeg, a progressive scan only selects the tables that it uses (DC tables for a first scan of DC
+   coefficients, none for a refining scan of them, and AC tables for a scan of AC coefficients). */
+void jpeg::Encoder::encodeScanHeader(BitStream& outputStream, ScanParameters const& scan){
+    bool const selectsDCTables = scan.m_spectralStart == 0 && scan.m_approximationHigh == 0;
+    bool const selectsACTables = scan.m_spectralEnd > 0;
+    std::vector<uint8_t> components;
+    for (uint8_t component = 0 ; component < 3 ; ++component){
+        if (scan.includesComponent(component)){
+            components.push_back(component);
+        }
+    }
 
     // SOS 
     outputStream.pushWord(markerStartOfScanSegmentSOS);
-    outputStream.pushWord(12); // length
-    outputStream.pushByte(3); // Number of components
-    // First component
-    outputStream.pushByte(1); // ID
-    outputStream.pushByte(0x00); // Huffman table
-    // Second component
-    outputStream.pushByte(2); // ID
-    outputStream.pushByte(0x11); // Huffman table
-    // Third component
-    outputStream.pushByte(3); // ID
-    outputStream.pushByte(0x11); // Huffman table
+    outputStream.pushWord(6 + 2 * components.size()); // length
+    outputStream.pushByte(components.size()); // Number of components
+    for (uint8_t const component : components){
+        uint8_t const tableID = component == 0 ? 0 : 1;
+        outputStream.pushByte(component + 1); // ID
+        outputStream.pushByte((selectsDCTables ? tableID << 4 : 0) | (selectsACTables ? tableID : 0)); // Huffman (or conditioning) tables
+    }
     // Spectral selection
-    outputStream.pushWord(0x003F);
-    // Skip
-    outputStream.pushByte(0x00);
+    outputStream.pushByte(scan.m_spectralStart);
+    outputStream.pushByte(scan.m_spectralEnd);
+    // Successive approximation
+    outputStream.pushByte((scan.m_approximationHigh << 4) | scan.m_approximationLow);
 }
 
-void jpeg::Encoder::decodeHeader(BitStream const& inputStream, BitStreamReadProgress& readProgress, BitmapImageRGB& outputImage) const{
-    if (inputStream.readNextAlignedWord(readProgress) != markerStartOfImageSegmentSOI){
+/* Reads the header of a JPEG, up to the start of its scan data. Segments may appear in any order before the SOS
+   segment, and application-specific and comment segments are skipped. The frame may be baseline (SOF0) or 
+   arithmetic-coded (SOF9). The third component must use the same tables as the second, as the pipeline distinguishes
+   only luminance and chrominance components. Returns the tables with which to decode the scan. */
+std::shared_ptr<jpeg::DecodingTables const> jpeg::Encoder::decodeHeader(BitStream const& inputStream, BitStreamReadProgress& readProgress, BitmapImageRGB& outputImage, uint16_t& restartInterval) const{
+    if (inputStream.getSize() < 2 || inputStream.readNextAlignedWord(readProgress) != markerStartOfImageSegmentSOI){
         throw std::runtime_error("Failed to find SOI marker");
     }
-    if (inputStream.readNextAlignedWord(readProgress) != markerJFIFImageSegmentAPP0){
-        throw std::runtime_error("Failed to find APP-0 marker");
-    }
-    else{
-        auto const startOfAPP0Payload = readProgress.currentByte;
-        auto const APP0length = inputStream.readNextAlignedWord(readProgress);
-        if (inputStream.readNextAlignedByte(readProgress) != 'J'){
-            throw std::runtime_error("Failed to find 'J'(FIF) in APP-0 payload");
-        }
-        if (inputStream.readNextAlignedByte(readProgress) != 'F'){
-            throw std::runtime_error("Failed to find (J)'F'(IF) in APP-0 payload");
-        }
-        if (inputStream.readNextAlignedByte(readProgress) != 'I'){
-            throw std::runtime_error("Failed to find (JF)'I'(F) in APP-0 payload");
-        }
-        if (inputStream.readNextAlignedByte(readProgress) != 'F'){
-            throw std::runtime_error("Failed to find (JFI)'F' in APP-0 payload");
-        }
-        if (inputStream.readNextAlignedByte(readProgress) != 00){
-            throw std::runtime_error("Failed to find 'JFIF' null-terminator in APP-0 payload");
-        }
-        if (inputStream.readNextAlignedWord(readProgress) != 0x0102){
-            throw std::runtime_error("JFIF version indicated by APP-0 payload is not 1.02");
+    std::array<std::optional<QuantisationTable>, 4> quantisationTables;
+    std::array<std::optional<HuffmanTableSpecification>, 8> huffmanTables;
+    // Conditioning tables not defined by a DAC segment take the default values of Section F.1.4.4
+    std::array<uint8_t, 8> conditioningValues = {0x10, 0x10, 0x10, 0x10, 5, 5, 5, 5};
+    std::array<uint8_t, 3> componentIDs, quantisationTableIDs;
+    bool frameFound = false;
+    bool arithmeticCoding = false;
+    restartInterval = 0;
+    while (true){
+        if (readProgress.currentByte + 2 > inputStream.getSize()){
+            throw std::runtime_error("Failed to find SOS marker");
+        }
+        uint16_t const marker = inputStream.readNextAlignedWord(readProgress);
+        // Every segment begins with its length, so the stream cannot end directly after a marker
+        if (readProgress.currentByte + 2 > inputStream.getSize()){
+            throw std::runtime_error("JPEG data ends within a segment");
+        }
+        if (marker == markerDefineQuantisationTableSegmentDQT){
+            Quantiser::decodeHeaderQuantisationTables(inputStream, readProgress, quantisationTables);
+        }
+        else if (marker == markerDefineHuffmanTableSegmentDHT){
+            HuffmanEncoder::decodeHeaderEntropyTables(inputStream, readProgress, huffmanTables);
+        }
+        else if (marker == markerDefineArithmeticConditioningSegmentDAC){
+            ArithmeticEncoder::decodeHeaderEntropyTables(inputStream, readProgress, conditioningValues);
+        }
+        else if (marker == markerStartOfFrame0SOF0 || marker == markerStartOfFrame9SOF9){
+            arithmeticCoding = marker == markerStartOfFrame9SOF9;
+            auto const SOF0length = readSegmentLength(inputStream, readProgress, "SOF0");
+            // The payload must hold at least the precision, dimensions and number of components
+            if (SOF0length < 8){
+                throw std::runtime_error("SOF0 length parameter does not correspond to payload size");
+            }
+            if (inputStream.readNextAlignedByte(readProgress) != 0x08){
+                throw std::runtime_error("Only 8-bit precision is supported");
+            }
+            outputImage.height = inputStream.readNextAlignedWord(readProgress);
+            outputImage.m_width = inputStream.readNextAlignedWord(readProgress);
+            if (outputImage.height == 0 || outputImage.m_width == 0){
+                throw std::runtime_error("Invalid image dimensions in SOF0 payload");
+            }
+            if (inputStream.readNextAlignedByte(readProgress) != 3){
+                throw std::runtime_error("Only three-component images are supported");
+            }
+            if (SOF0length != 8 + 3 * 3){
+                throw std::runtime_error("SOF0 length parameter does not correspond to payload size");
+            }
+            for (size_t component = 0 ; component < 3 ; ++component){
+                componentIDs[component] = inputStream.readNextAlignedByte(readProgress);
+                if (inputStream.readNextAlignedByte(readProgress) != 0x11){
+                    throw std::runtime_error("Only images without chroma subsampling are supported");
+                }
+                quantisationTableIDs[component] = inputStream.readNextAlignedByte(readProgress);
+                if (quantisationTableIDs[component] > 3){
+                    throw std::runtime_error("Invalid quantisation table ID in SOF0 payload");
+                }
+            }
+            frameFound = true;
         }
-        if (inputStream.readNextAlignedByte(readProgress) != 00){
-            throw std::runtime_error("Failed to find density units in APP-0 payload");
+        else if (marker == markerDefineRestartIntervalSegmentDRI){
+            if (readSegmentLength(inputStream, readProgress, "DRI") != 4){
+                throw std::runtime_error("DRI length parameter does not correspond to payload size");
+            }
+            restartInterval = inputStream.readNextAlignedWord(readProgress);
         }
-        if (inputStream.readNextAlignedWord(readProgress) != 0x0010){
-            throw std::runtime_error("Failed to find Xdensity in APP-0 payload");
+        else if ((marker >= markerJFIFImageSegmentAPP0 && marker <= markerJFIFImageSegmentAPP0 + 0xF) || marker == markerCommentSegmentCOM){
+            auto const startOfPayload = readProgress.currentByte;
+            readProgress.currentByte = startOfPayload + readSegmentLength(inputStream, readProgress, "APPn/COM");
         }
-        if (inputStream.readNextAlignedWord(readProgress) != 0x0010){
-            throw std::runtime_error("Failed to find Ydensity in APP-0 payload");
+        else if (marker == markerStartOfScanSegmentSOS){
+            break;
         }
-        if (inputStream.readNextAlignedWord(readProgress) != 0x0000){
-            throw std::runtime_error("Failed to find thumbnail size in APP-0 payload");
+        else if ((marker & 0xFFF0) == 0xFFC0 && marker != markerDefineHuffmanTableSegmentDHT){
+            throw std::runtime_error("Only baseline and arithmetic-coded sequential JPEGs are supported");
         }
-        if (APP0length != readProgress.currentByte - startOfAPP0Payload){
-            throw std::runtime_error("APP-0 length parameter does not correspond to payload size");
+        else{
+            throw std::runtime_error("Unexpected marker in JPEG header");
         }
     }
+    if (!frameFound){
+        throw std::runtime_error("Failed to find SOF0 marker before SOS marker");
+    }
 
-    /* Issue: allow disordered markers */
-
-    /* SKIP DQT decoding */
-    readProgress.currentByte += 2 /* Marker */ + 2 /* Len */ + 2 * 65 /* Table data */;
-
-    if (inputStream.readNextAlignedWord(readProgress) != markerStartOfFrame0SOF0){
-        throw std::runtime_error("Failed to find SOF0 marker");
+    // SOS
+    std::array<HuffmanTableSpecification const*, 6> componentHuffmanTables{};
+    std::array<ArithmeticConditioning, 3> componentConditioning;
+    auto const SOSlength = readSegmentLength(inputStream, readProgress, "SOS");
+    // The payload must hold at least the number of components
+    if (SOSlength < 3){
+        throw std::runtime_error("SOS length parameter does not correspond to payload size");
     }
-    else{
-        auto const startOfSOF0Payload = readProgress.currentByte;
-        auto const SOF0length = inputStream.readNextAlignedWord(readProgress);
-        if (inputStream.readNextAlignedByte(readProgress) != 0x08){
-            throw std::runtime_error("Failed to find precision in SOF0 payload");
-        }
-        outputImage.height = inputStream.readNextAlignedWord(readProgress);
-        outputImage.m_width = inputStream.readNextAlignedWord(readProgress);
-        if (inputStream.readNextAlignedByte(readProgress) != 3){
-            throw std::runtime_error("Failed to find number of components in SOF0 payload");
-        }
-        // First component
-        if (inputStream.readNextAlignedByte(readProgress) != 1){
-            throw std::runtime_error("Failed to find first component ID in SOF0 payload");
-        }
-        if (inputStream.readNextAlignedByte(readProgress) != 0x11){
-            throw std::runtime_error("Failed to find first component sampling factors in SOF0 payload");
-        }
-        if (inputStream.readNextAlignedByte(readProgress) != 0){
-            throw std::runtime_error("Failed to find first component quantisation table ID in SOF0 payload");
-        }
-        // Second component
-        if (inputStream.readNextAlignedByte(readProgress) != 2){
-            throw std::runtime_error("Failed to find second component ID in SOF0 payload");
-        }
-        if (inputStream.readNextAlignedByte(readProgress) != 0x11){
-            throw std::runtime_error("Failed to find second component sampling factors in SOF0 payload");
-        }
-        if (inputStream.readNextAlignedByte(readProgress) != 1){
-            throw std::runtime_error("Failed to find second component quantisation table ID in SOF0 payload");
+    if (inputStream.readNextAlignedByte(readProgress) != 3){
+        throw std::runtime_error("Only interleaved scans of all three components are supported");
+    }
+    if (SOSlength != 6 + 2 * 3){
+        throw std::runtime_error("SOS length parameter does not correspond to payload size");
+    }
+    for (size_t component = 0 ; component < 3 ; ++component){
+        if (inputStream.readNextAlignedByte(readProgress) != componentIDs[component]){
+            throw std::runtime_error("Component IDs in SOS payload do not correspond to those in SOF0 payload");
+        }
+        uint8_t const huffmanTableIDs = inputStream.readNextAlignedByte(readProgress);
+        if (arithmeticCoding){
+            if ((huffmanTableIDs >> 4) > 3 || (huffmanTableIDs & 0xF) > 3){
+                throw std::runtime_error("SOS payload refers to an invalid conditioning table");
+            }
+            uint8_t const dcConditioning = conditioningValues[huffmanTableIDs >> 4];
+            componentConditioning[component] = {.m_dcLowerBound = uint8_t(dcConditioning & 0xF), .m_dcUpperBound = uint8_t(dcConditioning >> 4),
+                                                .m_acThreshold = conditioningValues[4 + (huffmanTableIDs & 0xF)]};
+            continue;
         }
-        // Third component
-        if (inputStream.readNextAlignedByte(readProgress) != 3){
-            throw std::runtime_error("Failed to find third component ID in SOF0 payload");
+        if ((huffmanTableIDs >> 4) > 3 || (huffmanTableIDs & 0xF) > 3 || !huffmanTables[huffmanTableIDs >> 4] || !huffmanTables[4 + (huffmanTableIDs & 0xF)]){
+            throw std::runtime_error("SOS payload refers to an undefined Huffman table");
         }
-        if (inputStream.readNextAlignedByte(readProgress) != 0x11){
-            throw std::runtime_error("Failed to find third component sampling factors in SOF0 payload");
+        componentHuffmanTables[2 * component] = &*huffmanTables[huffmanTableIDs >> 4];
+        componentHuffmanTables[2 * component + 1] = &*huffmanTables[4 + (huffmanTableIDs & 0xF)];
+    }
+    if (inputStream.readNextAlignedWord(readProgress) != 0x003F){
+        throw std::runtime_error("Failed to find spectral selection of a sequential scan in SOS payload");
+    }
+    if (inputStream.readNextAlignedByte(readProgress) != 0){
+        throw std::runtime_error("Failed to find successive approximation of a sequential scan in SOS payload");
+    }
+
+    for (size_t component = 0 ; component < 3 ; ++component){
+        if (!quantisationTables[quantisationTableIDs[component]]){
+            throw std::runtime_error("SOF0 payload refers to an undefined quantisation table");
         }
-        if (inputStream.readNextAlignedByte(readProgress) != 1){
-            throw std::runtime_error("Failed to find third component quantisation table ID in SOF0 payload");
+    }
+    if (*quantisationTables[quantisationTableIDs[1]] != *quantisationTables[quantisationTableIDs[2]]
+        || (arithmeticCoding ? componentConditioning[1] != componentConditioning[2]
+                             : *componentHuffmanTables[2] != *componentHuffmanTables[4] || *componentHuffmanTables[3] != *componentHuffmanTables[5])){
+        throw std::runtime_error("Chrominance components with different tables are not supported");
+    }
+    if (arithmeticCoding){
+        return getDecodingTables(*quantisationTables[quantisationTableIDs[0]], *quantisationTables[quantisationTableIDs[1]], {},
+                                 std::array<ArithmeticConditioning, 2>{componentConditioning[0], componentConditioning[1]});
+    }
+    return getDecodingTables(*quantisationTables[quantisationTableIDs[0]], *quantisationTables[quantisationTableIDs[1]],
+                             {componentHuffmanTables[0], componentHuffmanTables[1], componentHuffmanTables[2], componentHuffmanTables[3]});
+}
+
+/* Returns the quantiser and entropy decoder for the given tables, only building them if they are not already cached.
+   The Huffman tables are given in the order luminance DC, luminance AC, chrominance DC, chrominance AC, and are 
+   ignored if the arithmetic conditioning (luminance, chrominance) of an arithmetic-coded JPEG is given instead. */
+std::shared_ptr<jpeg::DecodingTables const> jpeg::Encoder::getDecodingTables(QuantisationTable const& luminanceMatrix, QuantisationTable const& chrominanceMatrix,
+                                                                             std::array<HuffmanTableSpecification const*, 4> const& huffmanTables,
+                                                                             std::optional<std::array<ArithmeticConditioning, 2>> const& arithmeticConditioning) const{
+    // The key holds the contents of every table, so tables are only shared between JPEGs if they are identical
+    std::string key;
+    for (QuantisationTable const* matrix : {&luminanceMatrix, &chrominanceMatrix}){
+        key.append(reinterpret_cast<char const*>(matrix->data()), sizeof(QuantisationTable));
+    }
+    if (arithmeticConditioning){
+        key.push_back('A');
+        for (ArithmeticConditioning const& conditioning : *arithmeticConditioning){
+            key.append({char(conditioning.m_dcLowerBound), char(conditioning.m_dcUpperBound), char(conditioning.m_acThreshold)});
         }
-        if (SOF0length != readProgress.currentByte - startOfSOF0Payload){
-            throw std::runtime_error("SOF0 length parameter does not correspond to payload size");
+    }
+    else{
+        key.push_back('H');
+        for (HuffmanTableSpecification const* specification : huffmanTables){
+            key.append(specification->m_codeLengthCounts.begin(), specification->m_codeLengthCounts.end());
+            key.append(specification->m_values.begin(), specification->m_values.end());
         }
     }
 
-    /* SKIP DHT decoding */
-    readProgress.currentByte += 2 /* marker */ + 2 /* len */+ 4 /* IDs */+ 412 /* hardcoded tables */;
-
-    if (inputStream.readNextAlignedWord(readProgress) != markerStartOfScanSegmentSOS){
-        throw std::runtime_error("Failed to find SOS marker");
+    std::scoped_lock lock(m_decodingTablesMutex);
+    if (auto const cachedTables = m_decodingTables.find(key) ; cachedTables != m_decodingTables.end()){
+        return cachedTables->second;
+    }
+    auto tables = std::make_shared<DecodingTables>();
+    tables->m_quantiser = std::make_unique<Quantiser>(luminanceMatrix, chrominanceMatrix, m_quantiser->getSimdLevel());
+    tables->m_quantiser->applyTransformScaling(*m_discreteCosineTransformer);
+    if (arithmeticConditioning){
+        tables->m_arithmeticEncoder = std::make_unique<ArithmeticEncoder>((*arithmeticConditioning)[0], (*arithmeticConditioning)[1]);
     }
     else{
-        auto const startOfSOSPayload = readProgress.currentByte;
-        auto const SOSlength = inputStream.readNextAlignedWord(readProgress);
-        if (inputStream.readNextAlignedByte(readProgress) != 3){
-            throw std::runtime_error("Failed to find number of components in SOS payload");
-        }
-        // First component
-        if (inputStream.readNextAlignedByte(readProgress) != 1){
-            throw std::runtime_error("Failed to find first component ID in SOS payload");
-        }
-        if (inputStream.readNextAlignedByte(readProgress) != 0x00){
-            throw std::runtime_error("Failed to find first component Huffman table ID in SOS payload");
-        }
-        // Second component
-        if (inputStream.readNextAlignedByte(readProgress) != 2){
-            throw std::runtime_error("Failed to find second component ID in SOS payload");
-        }
-        if (inputStream.readNextAlignedByte(readProgress) != 0x11){
-            throw std::runtime_error("Failed to find second component Huffman table ID in SOS payload");
-        }
-        // Third component
-        if (inputStream.readNextAlignedByte(readProgress) != 3){
-            throw std::runtime_error("Failed to find third component ID in SOS payload");
-        }
-        if (inputStream.readNextAlignedByte(readProgress) != 0x11){
-            throw std::runtime_error("Failed to find third component Huffman table ID in SOS payload");
-        }
-        // Skip bytes
-        if (inputStream.readNextAlignedWord(readProgress) != 0x003F){
-            throw std::runtime_error("Failed to find spectral alignment in SOS payload");
-        }
-        if (inputStream.readNextAlignedByte(readProgress) != 0){
-            throw std::runtime_error("Failed to find skip byte in SOS payload");
-        }
-        if (SOSlength != readProgress.currentByte - startOfSOSPayload){
-            throw std::runtime_error("SOS length parameter does not correspond to payload size");
-        }
+        tables->m_entropyEncoder = std::make_unique<HuffmanEncoder>(*huffmanTables[0], *huffmanTables[1], *huffmanTables[2], *huffmanTables[3], m_quantiser->getSimdLevel());
+    }
+    if (m_decodingTables.size() >= maxCachedDecodingTables){
+        m_decodingTables.clear();
     }
-}
\ No newline at end of file
+    m_decodingTables.emplace(std::move(key), tables);
+    return tables;
+}
@@ -0,0 +1,30 @@
+#include "entropy_encoder.hpp"
+
+#if JPEG_SIMD_X86
+#include <immintrin.h>
+
+/* Each kernel compares the coefficients of a block with zero, packs the comparisons of 16 coefficients into a byte
+   each, and gathers the top bit of each byte, giving a bit for each coefficient in order */
+[[gnu::target("sse2")]] uint64_t jpeg::HuffmanEncoder::getNonZeroMaskSSE2(int16_t const* coefficients){
+    uint64_t zeroMask = 0;
+    for (size_t i = 0 ; i < BlockGrid::blockElements ; i += 16){
+        __m128i const low = _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const*>(coefficients + i)), _mm_setzero_si128());
+        __m128i const high = _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const*>(coefficients + i + 8)), _mm_setzero_si128());
+        zeroMask |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_packs_epi16(low, high)))) << i;
+    }
+    return ~zeroMask;
+}
+
+[[gnu::target("avx2")]] uint64_t jpeg::HuffmanEncoder::getNonZeroMaskAVX2(int16_t const* coefficients){
+    uint64_t zeroMask = 0;
+    for (size_t i = 0 ; i < BlockGrid::blockElements ; i += 32){
+        __m256i const low = _mm256_cmpeq_epi16(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(coefficients + i)), _mm256_setzero_si256());
+        __m256i const high = _mm256_cmpeq_epi16(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(coefficients + i + 16)), _mm256_setzero_si256());
+        // Packing works within 128-bit lanes, so the middle two quarters are swapped back into order
+        __m256i const packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(low, high), 0xD8);
+        zeroMask |= uint64_t(uint32_t(_mm256_movemask_epi8(packed))) << i;
+    }
+    return ~zeroMask;
+}
+
+#endif
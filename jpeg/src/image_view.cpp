@@ -0,0 +1,40 @@
+#include "image_view.hpp"
+
+jpeg::ImageView::ImageView(uint8_t const* data, uint16_t width, uint16_t height, size_t stride, PixelFormat format) :
+    m_data{data}, m_width{width}, m_height{height}, m_stride{stride}, m_format{format}{
+    if (m_stride < m_width * getBytesPerPixel(m_format)){
+        throw std::runtime_error("Image view stride is shorter than a row of pixels");
+    }
+}
+
+jpeg::ImageView::ImageView(BitmapImageRGB const& image) : 
+    m_data{reinterpret_cast<uint8_t const*>(image.m_imageData.data())}, m_width{image.m_width}, m_height{image.height}, 
+    m_stride{image.m_width * sizeof(BitmapImageRGB::PixelData)}, m_format{PixelFormat::RGB24}{
+    static_assert(sizeof(BitmapImageRGB::PixelData) == 3);
+}
+
+size_t jpeg::ImageView::getBytesPerPixel(PixelFormat format){
+    return (format == PixelFormat::RGBA32 || format == PixelFormat::BGRA32) ? 4 : 3;
+}
+
+/* Converts a run of pixels within a single row to packed RGB */
+void jpeg::ImageView::copyRow(uint16_t row, uint16_t firstCol, uint16_t numCols, BitmapImageRGB::PixelData* dest) const{
+    size_t const bytesPerPixel = getBytesPerPixel(m_format);
+    uint8_t const* src = m_data + row * m_stride + firstCol * bytesPerPixel;
+    switch (m_format){
+        case PixelFormat::RGB24:
+            std::memcpy(dest, src, numCols * sizeof(BitmapImageRGB::PixelData));
+            break;
+        case PixelFormat::RGBA32:
+            for (size_t col = 0 ; col < numCols ; ++col, src += 4){
+                dest[col] = {src[0], src[1], src[2]};
+            }
+            break;
+        case PixelFormat::BGR24:
+        case PixelFormat::BGRA32:
+            for (size_t col = 0 ; col < numCols ; ++col, src += bytesPerPixel){
+                dest[col] = {src[2], src[1], src[0]};
+            }
+            break;
+    }
+}
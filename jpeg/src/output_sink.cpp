@@ -0,0 +1,97 @@
+#include "output_sink.hpp"
+
+#include <unistd.h>
+
+void jpeg::OutputSink::write(std::span<uint8_t const> bytes){
+    if (!bytes.empty()){
+        m_bytesWritten += bytes.size();
+        writeBytes(bytes);
+    }
+}
+
+void jpeg::OutputSink::flush(){
+    flushBytes();
+}
+
+size_t jpeg::OutputSink::getBytesWritten() const{
+    return m_bytesWritten;
+}
+
+jpeg::BufferOutputSink::BufferOutputSink(std::span<uint8_t> buffer) : m_buffer{buffer}, m_bufferUsed{0}, m_overflowed{false}{
+}
+
+bool jpeg::BufferOutputSink::hasOverflowed() const{
+    return m_overflowed;
+}
+
+/* Returns the buffer size needed to hold all of the output written so far */
+size_t jpeg::BufferOutputSink::getRequiredSize() const{
+    return getBytesWritten();
+}
+
+/* Returns the part of the buffer which has been written to, which is incomplete if the buffer has overflowed */
+std::span<uint8_t const> jpeg::BufferOutputSink::getOutput() const{
+    return m_buffer.first(m_bufferUsed);
+}
+
+void jpeg::BufferOutputSink::writeBytes(std::span<uint8_t const> bytes){
+    if (m_overflowed){
+        return;
+    }
+    if (bytes.size() > m_buffer.size() - m_bufferUsed){
+        m_overflowed = true;
+        return;
+    }
+    std::memcpy(m_buffer.data() + m_bufferUsed, bytes.data(), bytes.size());
+    m_bufferUsed += bytes.size();
+}
+
+jpeg::FileDescriptorOutputSink::FileDescriptorOutputSink(int fileDescriptor, size_t chunkSize) : 
+    m_fileDescriptor{fileDescriptor}, m_chunkSize{std::max<size_t>(chunkSize, 1)}{
+    m_chunk.reserve(m_chunkSize);
+}
+
+/* Collects bytes into whole chunks, so that the file descriptor sees few, large writes */
+void jpeg::FileDescriptorOutputSink::writeBytes(std::span<uint8_t const> bytes){
+    while (!bytes.empty()){
+        if (m_chunk.empty() && bytes.size() >= m_chunkSize){
+            // Write whole chunks straight from the input
+            size_t const bytesToWrite = bytes.size() - bytes.size() % m_chunkSize;
+            writeToFileDescriptor(bytes.first(bytesToWrite));
+            bytes = bytes.subspan(bytesToWrite);
+            continue;
+        }
+        size_t const bytesToCopy = std::min(bytes.size(), m_chunkSize - m_chunk.size());
+        m_chunk.insert(m_chunk.end(), bytes.begin(), bytes.begin() + bytesToCopy);
+        bytes = bytes.subspan(bytesToCopy);
+        if (m_chunk.size() == m_chunkSize){
+            writeToFileDescriptor(m_chunk);
+            m_chunk.clear();
+        }
+    }
+}
+
+void jpeg::FileDescriptorOutputSink::flushBytes(){
+    writeToFileDescriptor(m_chunk);
+    m_chunk.clear();
+}
+
+void jpeg::FileDescriptorOutputSink::writeToFileDescriptor(std::span<uint8_t const> bytes) const{
+    while (!bytes.empty()){
+        ssize_t const bytesWritten = ::write(m_fileDescriptor, bytes.data(), bytes.size());
+        if (bytesWritten < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            throw std::runtime_error("Failed to write to file descriptor (" + std::string(std::strerror(errno)) + ")");
+        }
+        bytes = bytes.subspan(bytesWritten);
+    }
+}
+
+jpeg::CallbackOutputSink::CallbackOutputSink(Callback callback) : m_callback{std::move(callback)}{
+}
+
+void jpeg::CallbackOutputSink::writeBytes(std::span<uint8_t const> bytes){
+    m_callback(bytes);
+}
@@ -0,0 +1,236 @@
+#include "entropy_encoder.hpp"
+
+namespace{
+    // The longest run of blocks that an EOBn symbol can code (EOB14 with 14 additional bits)
+    size_t const maxEndOfBandRun = 0x7FFF;
+}
+
+std::array<jpeg::ScanParameters, 10> const jpeg::ProgressiveHuffmanEncoder::standardScans{{
+    {.m_component = 0, .m_spectralStart = 0, .m_spectralEnd = 0, .m_approximationHigh = 0, .m_approximationLow = 1},
+    {.m_component = 0, .m_spectralStart = 1, .m_spectralEnd = 5, .m_approximationHigh = 0, .m_approximationLow = 2},
+    {.m_component = 2, .m_spectralStart = 1, .m_spectralEnd = 63, .m_approximationHigh = 0, .m_approximationLow = 1},
+    {.m_component = 1, .m_spectralStart = 1, .m_spectralEnd = 63, .m_approximationHigh = 0, .m_approximationLow = 1},
+    {.m_component = 0, .m_spectralStart = 6, .m_spectralEnd = 63, .m_approximationHigh = 0, .m_approximationLow = 2},
+    {.m_component = 0, .m_spectralStart = 1, .m_spectralEnd = 63, .m_approximationHigh = 2, .m_approximationLow = 1},
+    {.m_component = 0, .m_spectralStart = 0, .m_spectralEnd = 0, .m_approximationHigh = 1, .m_approximationLow = 0},
+    {.m_component = 2, .m_spectralStart = 1, .m_spectralEnd = 63, .m_approximationHigh = 1, .m_approximationLow = 0},
+    {.m_component = 1, .m_spectralStart = 1, .m_spectralEnd = 63, .m_approximationHigh = 1, .m_approximationLow = 0},
+    {.m_component = 0, .m_spectralStart = 1, .m_spectralEnd = 63, .m_approximationHigh = 1, .m_approximationLow = 0}
+}};
+
+/* Builds the tables for the symbols counted over the scan - DC tables for a scan of DC coefficients, and AC tables
+   otherwise. A scan refining DC coefficients codes their bits directly, and needs no tables. */
+jpeg::ProgressiveHuffmanEncoder::ProgressiveHuffmanEncoder(ScanParameters const& scan, SymbolFrequencies const& frequencies) : m_scan{scan}{
+    bool const isDCScan = scan.m_spectralStart == 0;
+    if (scan.m_spectralStart > scan.m_spectralEnd || scan.m_spectralEnd >= BlockGrid::blockElements || (isDCScan && scan.m_spectralEnd != 0)){
+        throw std::runtime_error("Progressive scans must code either the DC coefficients or a band of AC coefficients");
+    }
+    if (scan.m_approximationLow > 13 || (scan.m_approximationHigh != 0 && scan.m_approximationHigh != scan.m_approximationLow + 1)){
+        throw std::runtime_error("Progressive scans must refine coefficients by one bit at a time");
+    }
+    if (scan.m_component > 2){
+        throw std::runtime_error("Invalid component in progressive scan");
+    }
+    for (size_t table = 0 ; table < m_specifications.size() ; ++table){
+        m_specifications[table] = HuffmanEncoder::buildOptimisedSpecification(isDCScan ? frequencies.m_dcFrequencies[table] : frequencies.m_acFrequencies[table]);
+        // Assign the codes in order of increasing length, as described in Annex C of ITU-T81
+        m_codes[table].fill({0, 0});
+        uint32_t codeWord = 0;
+        size_t symbolIndex = 0;
+        for (size_t codeLength = 1 ; codeLength <= m_specifications[table].m_codeLengthCounts.size() ; ++codeLength){
+            for (size_t i = 0 ; i < m_specifications[table].m_codeLengthCounts[codeLength - 1] ; ++i){
+                m_codes[table][m_specifications[table].m_values[symbolIndex++]] = HuffmanCode{codeLength, uint16_t(codeWord++)};
+            }
+            codeWord <<= 1;
+        }
+    }
+}
+
+/* Writes a DHT segment holding the tables used by the scan: both DC tables for a scan of DC coefficients, or the AC
+   table of the component of a scan of AC coefficients */
+void jpeg::ProgressiveHuffmanEncoder::encodeHeaderEntropyTables(BitStream& outputStream) const{
+    bool const isDCScan = m_scan.m_spectralStart == 0;
+    if (isDCScan && m_scan.m_approximationHigh != 0){
+        return;
+    }
+    std::vector<uint8_t> tableIDs;
+    for (uint8_t tableID = 0 ; tableID < m_specifications.size() ; ++tableID){
+        if (isDCScan || tableID == (m_scan.m_component == 0 ? 0 : 1)){
+            tableIDs.push_back(tableID);
+        }
+    }
+    outputStream.pushWord(markerDefineHuffmanTableSegmentDHT);
+    size_t length = 2;
+    for (uint8_t const tableID : tableIDs){
+        length += 1 + m_specifications[tableID].m_codeLengthCounts.size() + m_specifications[tableID].m_values.size();
+    }
+    outputStream.pushWord(length);
+    for (uint8_t const tableID : tableIDs){
+        outputStream.pushByte((isDCScan ? 0x00 : 0x10) | tableID); // table type + ID
+        std::ranges::for_each(m_specifications[tableID].m_codeLengthCounts, [&outputStream](uint8_t const& len){outputStream.pushByte(len);});
+        std::ranges::for_each(m_specifications[tableID].m_values, [&outputStream](uint8_t const& val){outputStream.pushByte(val);});
+    }
+}
+
+jpeg::ProgressiveHuffmanEncoder::IntervalEncoder::IntervalEncoder(ProgressiveHuffmanEncoder const& progressiveEncoder, BitStream& outputStream) :
+                                                                  m_progressiveEncoder{&progressiveEncoder}, m_outputStream{&outputStream},
+                                                                  m_frequencies{nullptr}, m_scan{progressiveEncoder.m_scan}{
+}
+
+jpeg::ProgressiveHuffmanEncoder::IntervalEncoder::IntervalEncoder(ScanParameters const& scan, SymbolFrequencies& frequencies) :
+                                                                  m_progressiveEncoder{nullptr}, m_outputStream{nullptr},
+                                                                  m_frequencies{&frequencies}, m_scan{scan}{
+}
+
+/* Codes the coefficients of a block that the scan includes. A scan refining DC coefficients codes just their next
+   bit, without a symbol. */
+void jpeg::ProgressiveHuffmanEncoder::IntervalEncoder::encode(QuantisedBlockChannelData const& input, size_t component, bool isLuminanceComponent){
+    if (m_scan.m_spectralStart == 0){
+        if (m_scan.m_approximationHigh == 0){
+            encodeDCFirst(input, component, isLuminanceComponent);
+        }
+        else{
+            pushBits((input.m_data[0] >> m_scan.m_approximationLow) & 1, 1);
+        }
+    }
+    else{
+        m_endOfBandRunIsLuminance = isLuminanceComponent;
+        if (m_scan.m_approximationHigh == 0){
+            encodeACFirst(input, isLuminanceComponent);
+        }
+        else{
+            encodeACRefinement(input, isLuminanceComponent);
+        }
+    }
+}
+
+/* Codes the run of blocks left at the end of the interval */
+void jpeg::ProgressiveHuffmanEncoder::IntervalEncoder::finish(){
+    pushEndOfBandRun();
+}
+
+/* Codes the DC coefficient, shifted down to bit Al, as the difference from that of the previous block of the
+   component, in the same way as a sequential scan (Section G.1.2.1) */
+void jpeg::ProgressiveHuffmanEncoder::IntervalEncoder::encodeDCFirst(QuantisedBlockChannelData const& input, size_t component, bool isLuminanceComponent){
+    // An arithmetic shift, so that the bits coded by refinement scans are those of the two's complement value
+    int16_t const value = int16_t(input.m_data[0] >> m_scan.m_approximationLow);
+    int const dcDifference = value - m_lastDCValues[component];
+    m_lastDCValues[component] = value;
+    uint16_t const dcDiffAmplitude = uint16_t(dcDifference > 0 ? dcDifference : -dcDifference);
+    uint8_t const categorySSSS = std::bit_width(dcDiffAmplitude);
+    pushSymbol(categorySSSS, true, isLuminanceComponent);
+    // Negative values are coded as the one's complement of their amplitude, i.e. as the value less 1
+    pushBits(uint32_t(dcDifference > 0 ? dcDifference : dcDifference - 1), categorySSSS);
+}
+
+/* Codes the band of AC coefficients, with their magnitudes shifted down to bit Al, as runs of zeroes and values
+   (Section G.1.2.2). A block with nothing after its last non-zero value extends the run of blocks ending in an EOB,
+   rather than coding an EOB of its own. */
+void jpeg::ProgressiveHuffmanEncoder::IntervalEncoder::encodeACFirst(QuantisedBlockChannelData const& input, bool isLuminanceComponent){
+    size_t runLength = 0;
+    for (size_t index = m_scan.m_spectralStart ; index <= m_scan.m_spectralEnd ; ++index){
+        int16_t const coefficient = input.m_data[zigZagIndices[index]];
+        uint16_t const amplitude = uint16_t(coefficient < 0 ? -coefficient : coefficient) >> m_scan.m_approximationLow;
+        if (amplitude == 0){
+            ++runLength;
+            continue;
+        }
+        pushEndOfBandRun();
+        for ( ; runLength > 15 ; runLength -= 16){
+            pushSymbol(0xF0, false, isLuminanceComponent);
+        }
+        uint8_t const categorySSSS = std::bit_width(amplitude);
+        pushSymbol(uint8_t(runLength << 4) | categorySSSS, false, isLuminanceComponent);
+        pushBits(coefficient < 0 ? ~uint32_t(amplitude) : amplitude, categorySSSS);
+        runLength = 0;
+    }
+    if (runLength > 0 && ++m_endOfBandRun == maxEndOfBandRun){
+        pushEndOfBandRun();
+    }
+}
+
+/* Codes the next bit (bit Al) of the band of AC coefficients, following the procedure of libjpeg. Coefficients which
+   become non-zero at this bit are coded as runs and values (of magnitude 1, so just a sign bit) as in a first scan,
+   where the run counts only coefficients which are still zero. The bits of coefficients which are already non-zero
+   are correction bits, coded in turn after the symbol which follows them, or after the EOB that ends their block. */
+void jpeg::ProgressiveHuffmanEncoder::IntervalEncoder::encodeACRefinement(QuantisedBlockChannelData const& input, bool isLuminanceComponent){
+    std::array<uint16_t, BlockGrid::blockElements> amplitudes;
+    size_t lastNewlyNonZeroIndex = 0;
+    for (size_t index = m_scan.m_spectralStart ; index <= m_scan.m_spectralEnd ; ++index){
+        int16_t const coefficient = input.m_data[zigZagIndices[index]];
+        amplitudes[index] = uint16_t(coefficient < 0 ? -coefficient : coefficient) >> m_scan.m_approximationLow;
+        if (amplitudes[index] == 1){
+            lastNewlyNonZeroIndex = index;
+        }
+    }
+    std::array<uint8_t, BlockGrid::blockElements> correctionBits;
+    size_t numCorrectionBits = 0;
+    auto pushCorrectionBits = [&]{
+        for (size_t i = 0 ; i < numCorrectionBits ; ++i){
+            pushBits(correctionBits[i], 1);
+        }
+        numCorrectionBits = 0;
+    };
+    size_t runLength = 0;
+    for (size_t index = m_scan.m_spectralStart ; index <= m_scan.m_spectralEnd ; ++index){
+        if (amplitudes[index] == 0){
+            ++runLength;
+            continue;
+        }
+        // Runs of 16 zeroes need a ZRL, unless no newly non-zero coefficient follows (so that the EOB covers them)
+        for ( ; runLength > 15 && index <= lastNewlyNonZeroIndex ; runLength -= 16){
+            pushEndOfBandRun();
+            pushSymbol(0xF0, false, isLuminanceComponent);
+            pushCorrectionBits();
+        }
+        if (amplitudes[index] > 1){
+            correctionBits[numCorrectionBits++] = amplitudes[index] & 1;
+            continue;
+        }
+        pushEndOfBandRun();
+        pushSymbol(uint8_t(runLength << 4) | 1, false, isLuminanceComponent);
+        pushBits(input.m_data[zigZagIndices[index]] < 0 ? 0 : 1, 1);
+        pushCorrectionBits();
+        runLength = 0;
+    }
+    if (runLength > 0 || numCorrectionBits > 0){
+        m_endOfBandRunCorrectionBits.insert(m_endOfBandRunCorrectionBits.end(), correctionBits.begin(), correctionBits.begin() + numCorrectionBits);
+        if (++m_endOfBandRun == maxEndOfBandRun){
+            pushEndOfBandRun();
+        }
+    }
+}
+
+/* Codes the run of blocks ending in an EOB (if there is one) as an EOBn symbol, where n is the position of the
+   leading one of the run length, followed by the bits of the length below it, then the correction bits of the run */
+void jpeg::ProgressiveHuffmanEncoder::IntervalEncoder::pushEndOfBandRun(){
+    if (m_endOfBandRun == 0){
+        return;
+    }
+    uint8_t const numBits = std::bit_width(m_endOfBandRun) - 1;
+    pushSymbol(uint8_t(numBits << 4), false, m_endOfBandRunIsLuminance);
+    pushBits(uint32_t(m_endOfBandRun), numBits);
+    m_endOfBandRun = 0;
+    for (uint8_t const bit : m_endOfBandRunCorrectionBits){
+        pushBits(bit, 1);
+    }
+    m_endOfBandRunCorrectionBits.clear();
+}
+
+void jpeg::ProgressiveHuffmanEncoder::IntervalEncoder::pushSymbol(uint8_t symbol, bool isDC, bool isLuminanceComponent){
+    if (m_frequencies){
+        ++(isDC ? m_frequencies->m_dcFrequencies : m_frequencies->m_acFrequencies)[!isLuminanceComponent][symbol];
+        return;
+    }
+    HuffmanCode const huffCode = m_progressiveEncoder->m_codes[!isLuminanceComponent][symbol];
+    if (huffCode.m_codeLength == 0){
+        throw std::runtime_error("No Huffman code for symbol of progressive scan.");
+    }
+    m_outputStream->pushBitsu32(huffCode.m_codeWord, huffCode.m_codeLength);
+}
+
+void jpeg::ProgressiveHuffmanEncoder::IntervalEncoder::pushBits(uint32_t bits, size_t numBits){
+    if (m_outputStream && numBits > 0){
+        m_outputStream->pushBitsu32(bits, numBits);
+    }
+}
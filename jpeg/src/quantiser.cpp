@@ -1,6 +1,6 @@
 #include "quantiser.hpp"
 
-jpeg::Quantiser::Quantiser(int quality){
+jpeg::Quantiser::Quantiser(int quality, SimdLevel simdLevel) : m_simdLevel{std::min(simdLevel, getSupportedSimdLevel())}{
     /* Generates a quantisation matrix of a given quality, as described in 
     this SO answer https://stackoverflow.com/a/29216609 */
     if (quality < 1){
@@ -30,6 +30,10 @@ jpeg::Quantiser::Quantiser(int quality){
         if (m_luminanceQuantisationMatrix[i] == 0){
             m_luminanceQuantisationMatrix[i] = 1;
         }
+        // Baseline JPEGs only allow 8-bit quantisation tables
+        else if (m_luminanceQuantisationMatrix[i] > 255){
+            m_luminanceQuantisationMatrix[i] = 255;
+        }
     }
 
     /* Base chrominance quantisation matrix as defined in Annex K of ITU T81 */ 
@@ -51,35 +55,141 @@ jpeg::Quantiser::Quantiser(int quality){
         if (m_chrominanceQuantisationMatrix[i] == 0){
             m_chrominanceQuantisationMatrix[i] = 1;
         }
+        // Baseline JPEGs only allow 8-bit quantisation tables
+        else if (m_chrominanceQuantisationMatrix[i] > 255){
+            m_chrominanceQuantisationMatrix[i] = 255;
+        }
+    }
+    m_forwardScaleFactors.fill(1);
+    m_inverseScaleFactors.fill(1);
+    updateScaledMatrices();
+}
+
+/* Uses the given quantisation matrices, e.g. as read from the DQT segment of a JPEG */
+jpeg::Quantiser::Quantiser(QuantisationTable const& luminanceMatrix, QuantisationTable const& chrominanceMatrix, SimdLevel simdLevel) 
+    : m_luminanceQuantisationMatrix{luminanceMatrix}, m_chrominanceQuantisationMatrix{chrominanceMatrix}, m_simdLevel{std::min(simdLevel, getSupportedSimdLevel())}{
+    m_forwardScaleFactors.fill(1);
+    m_inverseScaleFactors.fill(1);
+    updateScaledMatrices();
+}
+
+/* Folds any scale factors left in the coefficients by the transformer into the quantisation and dequantisation steps */
+void jpeg::Quantiser::applyTransformScaling(DiscreteCosineTransformer const& transformer){
+    m_forwardScaleFactors = transformer.getForwardScaleFactors();
+    m_inverseScaleFactors = transformer.getInverseScaleFactors();
+    m_integerCoefficients = transformer.hasIntegerCoefficients();
+    updateScaledMatrices();
+}
+
+void jpeg::Quantiser::updateScaledMatrices(){
+    for (size_t i = 0 ; i < BlockGrid::blockElements ; ++i){
+        m_luminanceDivisors[i] = m_luminanceQuantisationMatrix[i] * m_forwardScaleFactors[i];
+        m_chrominanceDivisors[i] = m_chrominanceQuantisationMatrix[i] * m_forwardScaleFactors[i];
+        m_luminanceReciprocals[i] = 1 / m_luminanceDivisors[i];
+        m_chrominanceReciprocals[i] = 1 / m_chrominanceDivisors[i];
+        m_luminanceMultipliers[i] = m_luminanceQuantisationMatrix[i] * m_inverseScaleFactors[i];
+        m_chrominanceMultipliers[i] = m_chrominanceQuantisationMatrix[i] * m_inverseScaleFactors[i];
     }
+    for (size_t i = 0 ; i < BlockGrid::blockElements ; ++i){
+        m_luminanceZigZagDivisors[i] = m_luminanceDivisors[zigZagIndices[i]];
+        m_chrominanceZigZagDivisors[i] = m_chrominanceDivisors[zigZagIndices[i]];
+        m_luminanceZigZagReciprocals[i] = m_luminanceReciprocals[zigZagIndices[i]];
+        m_chrominanceZigZagReciprocals[i] = m_chrominanceReciprocals[zigZagIndices[i]];
+    }
+}
+
+jpeg::SimdLevel jpeg::Quantiser::getSimdLevel() const{
+    return m_simdLevel;
 }
 
 jpeg::QuantisedBlockChannelData jpeg::Quantiser::quantise(DctBlockChannelData const& dctInput, bool useLuminanceMatrix) const{
+    return quantiseCoefficients(dctInput.m_data, useLuminanceMatrix ? m_luminanceDivisors : m_chrominanceDivisors,
+                                useLuminanceMatrix ? m_luminanceReciprocals : m_chrominanceReciprocals);
+}
+
+/* Quantises a block as quantise() does, but gives the coefficients in zig-zag order, as the entropy encoder takes 
+   them. The coefficients are gathered into zig-zag order before quantisation, so that the kernels store the 
+   quantised block in that order. */
+jpeg::QuantisedBlockChannelData jpeg::Quantiser::quantiseToZigZag(DctBlockChannelData const& dctInput, bool useLuminanceMatrix) const{
+    std::array<float, BlockGrid::blockElements> zigZagCoefficients;
+    for (size_t i = 0 ; i < BlockGrid::blockElements ; ++i){
+        zigZagCoefficients[i] = dctInput.m_data[zigZagIndices[i]];
+    }
+    return quantiseCoefficients(zigZagCoefficients, useLuminanceMatrix ? m_luminanceZigZagDivisors : m_chrominanceZigZagDivisors,
+                                useLuminanceMatrix ? m_luminanceZigZagReciprocals : m_chrominanceZigZagReciprocals);
+}
+
+/* Quantises coefficients by the divisors in the same order, whichever order that is */
+jpeg::QuantisedBlockChannelData jpeg::Quantiser::quantiseCoefficients(std::array<float, BlockGrid::blockElements> const& coefficients, std::array<float, BlockGrid::blockElements> const& divisors, std::array<float, BlockGrid::blockElements> const& reciprocals) const{
     QuantisedBlockChannelData output;
-    if (useLuminanceMatrix){
-        for (size_t i = 0 ; i < dctInput.m_data.size() ; ++i){
-            output.m_data[i] = std::floor(0.5 + dctInput.m_data[i]/m_luminanceQuantisationMatrix[i]);
-        }
+#if JPEG_SIMD_X86
+    if (m_simdLevel == SimdLevel::AVX2){
+        (m_integerCoefficients ? quantiseIntegerCoefficientsAVX2 : quantiseAVX2)(coefficients.data(), divisors.data(), reciprocals.data(), output.m_data.data());
+        return output;
     }
-    else{
-        for (size_t i = 0 ; i < dctInput.m_data.size() ; ++i){
-            output.m_data[i] = std::floor(0.5 + dctInput.m_data[i]/m_chrominanceQuantisationMatrix[i]);
-        }
+    if (m_simdLevel == SimdLevel::SSE2){
+        (m_integerCoefficients ? quantiseIntegerCoefficientsSSE2 : quantiseSSE2)(coefficients.data(), divisors.data(), reciprocals.data(), output.m_data.data());
+        return output;
+    }
+#else
+    (void)reciprocals;
+#endif
+    if (m_integerCoefficients){
+        return quantiseIntegerCoefficients(coefficients, divisors);
+    }
+    for (size_t i = 0 ; i < coefficients.size() ; ++i){
+        output.m_data[i] = std::floor(0.5 + coefficients[i]/divisors[i]);
+    }
+    return output;
+}
+
+/* Rounds each (integral) coefficient divided by its (integral) divisor to the nearest integer, with halves rounded 
+   up as in quantise(). No floating-point arithmetic is involved, so the result is the same on every build. */
+jpeg::QuantisedBlockChannelData jpeg::Quantiser::quantiseIntegerCoefficients(std::array<float, BlockGrid::blockElements> const& coefficients, std::array<float, BlockGrid::blockElements> const& divisors){
+    QuantisedBlockChannelData output;
+    for (size_t i = 0 ; i < coefficients.size() ; ++i){
+        // floor(c / d + 1/2) = floor((2c + d) / 2d)
+        int32_t const numerator = 2 * int32_t(coefficients[i]) + int32_t(divisors[i]);
+        int32_t const denominator = 2 * int32_t(divisors[i]);
+        output.m_data[i] = (numerator >= 0) ? numerator / denominator : -((denominator - 1 - numerator) / denominator);
+    }
+    return output;
+}
+
+/* The unrounded quotients of a block, in units of its quantisation steps, for rate-distortion optimised quantisation */
+std::array<float, jpeg::BlockGrid::blockElements> jpeg::Quantiser::getQuotients(DctBlockChannelData const& dctInput, bool useLuminanceMatrix) const{
+    std::array<float, BlockGrid::blockElements> const& divisors = useLuminanceMatrix ? m_luminanceDivisors : m_chrominanceDivisors;
+    std::array<float, BlockGrid::blockElements> output;
+    for (size_t i = 0 ; i < dctInput.m_data.size() ; ++i){
+        output[i] = dctInput.m_data[i] / divisors[i];
     }
     return output;
 }
 
+/* The quantisation step of each coefficient, in the units of the (unscaled) discrete cosine transform */
+std::array<float, jpeg::BlockGrid::blockElements> jpeg::Quantiser::getStepSizes(bool useLuminanceMatrix) const{
+    std::array<uint16_t, BlockGrid::blockElements> const& quantisationMatrix = useLuminanceMatrix ? m_luminanceQuantisationMatrix : m_chrominanceQuantisationMatrix;
+    std::array<float, BlockGrid::blockElements> output;
+    std::ranges::copy(quantisationMatrix, output.begin());
+    return output;
+}
+
 jpeg::DctBlockChannelData jpeg::Quantiser::dequantise(jpeg::QuantisedBlockChannelData const& quantisedChannelData, bool useLuminanceMatrix) const{
+    std::array<float, BlockGrid::blockElements> const& multipliers = useLuminanceMatrix ? m_luminanceMultipliers : m_chrominanceMultipliers;
     DctBlockChannelData output;
-    if (useLuminanceMatrix){
-        for (size_t i = 0 ; i < quantisedChannelData.m_data.size() ; ++i){
-            output.m_data[i] = quantisedChannelData.m_data[i] * float(m_luminanceQuantisationMatrix[i]);
-        }
+    output.m_nonZeroExtent = quantisedChannelData.m_nonZeroExtent;
+#if JPEG_SIMD_X86
+    if (m_simdLevel == SimdLevel::AVX2){
+        dequantiseAVX2(quantisedChannelData.m_data.data(), multipliers.data(), output.m_data.data());
+        return output;
     }
-    else{
-        for (size_t i = 0 ; i < quantisedChannelData.m_data.size() ; ++i){
-            output.m_data[i] = quantisedChannelData.m_data[i] * float(m_chrominanceQuantisationMatrix[i]);
-        }
+    if (m_simdLevel == SimdLevel::SSE2){
+        dequantiseSSE2(quantisedChannelData.m_data.data(), multipliers.data(), output.m_data.data());
+        return output;
+    }
+#endif
+    for (size_t i = 0 ; i < quantisedChannelData.m_data.size() ; ++i){
+        output.m_data[i] = quantisedChannelData.m_data[i] * multipliers[i];
     }
     return output;
 }
@@ -88,9 +198,6 @@ void jpeg::Quantiser::encodeHeaderQuantisationTables(BitStream& outputStream) co
     outputStream.pushWord(markerDefineQuantisationTableSegmentDQT);
     outputStream.pushWord(2 + 2 * 65); // Length
     outputStream.pushByte(0x00); // Precision + table ID
-
-    /* Temporary hardcoded zigzag indices - extract zig zag method from entropyencoder for use here */
-    std::array<uint8_t, BlockGrid::blockElements> zigZagIndices{0,1,8,16,9,2,3,10,17,24,32,25,18,11,4,5,12,19,26,33,40,48,41,34,27,20,13,6,7,14,21,28,35,42,49,56,57,50,43,36,29,22,15,23,30,37,44,51,58,59,52,45,38,31,39,46,53,60,61,54,47,55,62,63};
     for (auto const& index : zigZagIndices){
         outputStream.pushByte(m_luminanceQuantisationMatrix[index]);
     }
@@ -99,4 +206,35 @@ void jpeg::Quantiser::encodeHeaderQuantisationTables(BitStream& outputStream) co
     for (auto const& index : zigZagIndices){
         outputStream.pushByte(m_chrominanceQuantisationMatrix[index]);
     }
-}
\ No newline at end of file
+}
+
+/* Reads the tables of a DQT segment (following its marker) into the given slots, by table ID. Tables may have
+   8- or 16-bit precision, and are stored in zig-zag order. */
+void jpeg::Quantiser::decodeHeaderQuantisationTables(BitStream const& inputStream, BitStreamReadProgress& readProgress, std::array<std::optional<QuantisationTable>, 4>& tables){
+    auto const startOfDQTPayload = readProgress.currentByte;
+    auto const DQTlength = inputStream.readNextAlignedWord(readProgress);
+    if (startOfDQTPayload + DQTlength > inputStream.getSize()){
+        throw std::runtime_error("DQT length parameter exceeds size of input JPEG data");
+    }
+    while (readProgress.currentByte < startOfDQTPayload + DQTlength){
+        uint8_t const precisionAndID = inputStream.readNextAlignedByte(readProgress);
+        bool const sixteenBitPrecision = (precisionAndID >> 4) == 1;
+        if ((precisionAndID >> 4) > 1 || (precisionAndID & 0xF) > 3){
+            throw std::runtime_error("Invalid quantisation table precision or ID in DQT payload");
+        }
+        if (readProgress.currentByte + (sixteenBitPrecision ? 2 : 1) * BlockGrid::blockElements > startOfDQTPayload + DQTlength){
+            throw std::runtime_error("DQT length parameter does not correspond to payload size");
+        }
+        QuantisationTable table;
+        for (auto const& index : zigZagIndices){
+            table[index] = sixteenBitPrecision ? inputStream.readNextAlignedWord(readProgress) : inputStream.readNextAlignedByte(readProgress);
+            if (table[index] == 0){
+                throw std::runtime_error("Quantisation table contains a zero divisor");
+            }
+        }
+        tables[precisionAndID & 0xF] = table;
+    }
+    if (DQTlength != readProgress.currentByte - startOfDQTPayload){
+        throw std::runtime_error("DQT length parameter does not correspond to payload size");
+    }
+}
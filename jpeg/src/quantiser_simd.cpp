@@ -0,0 +1,150 @@
+#include "quantiser.hpp"
+
+#if JPEG_SIMD_X86
+#include <immintrin.h>
+
+/* Each kernel rounds the quotients of a block to the nearest integer, with halves rounded up, as in the scalar
+   Quantiser::quantise(). Quotients are calculated by multiplying by the reciprocals of the divisors, which differs
+   from the correctly rounded quotient by at most 3 ulps. If any quotient in a vector lies closer than this to a
+   rounding boundary (k + 1/2), the whole vector is recalculated by division, which is rarely necessary. */
+namespace{
+    // Bounds the relative error of multiplying by the reciprocal, with a wide margin
+    float const reciprocalTolerance = 1.0f / (1 << 21);
+
+    [[gnu::always_inline, gnu::target("sse2")]] inline __m128 floorSSE2(__m128 x){
+        __m128 const truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+        // Truncation rounds negative non-integers up
+        return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.0f)));
+    }
+
+    [[gnu::always_inline, gnu::target("sse2")]] inline __m128 absSSE2(__m128 x){
+        return _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+    }
+
+    /* True if rounding any quotient may differ from rounding the correctly rounded quotient */
+    [[gnu::always_inline, gnu::target("sse2")]] inline bool isNearRoundingBoundarySSE2(__m128 quotient){
+        __m128 const distance = absSSE2(_mm_sub_ps(_mm_sub_ps(quotient, floorSSE2(quotient)), _mm_set1_ps(0.5f)));
+        __m128 const tolerance = _mm_mul_ps(absSSE2(quotient), _mm_set1_ps(reciprocalTolerance));
+        return _mm_movemask_ps(_mm_cmple_ps(distance, tolerance)) != 0;
+    }
+
+    /* floor(x + 1/2), calculated exactly (unlike the sum x + 1/2 in single precision) */
+    [[gnu::always_inline, gnu::target("sse2")]] inline __m128i roundHalfUpSSE2(__m128 x){
+        __m128 const floored = floorSSE2(x);
+        __m128 const roundUp = _mm_and_ps(_mm_cmpge_ps(_mm_sub_ps(x, floored), _mm_set1_ps(0.5f)), _mm_set1_ps(1.0f));
+        return _mm_cvttps_epi32(_mm_add_ps(floored, roundUp));
+    }
+
+    [[gnu::always_inline, gnu::target("sse2")]] inline __m128i quantiseSSE2(float const* coefficients, float const* divisors, float const* reciprocals){
+        __m128 const coefficient = _mm_loadu_ps(coefficients);
+        __m128 quotient = _mm_mul_ps(coefficient, _mm_loadu_ps(reciprocals));
+        if (isNearRoundingBoundarySSE2(quotient)){
+            quotient = _mm_div_ps(coefficient, _mm_loadu_ps(divisors));
+        }
+        return roundHalfUpSSE2(quotient);
+    }
+
+    /* floor((2c + d) / 2d) for integral coefficients c and divisors d, with all intermediate values integers below
+       2^24 (so exact in single precision). The quotient is estimated using the reciprocal, then corrected by at
+       most 1 using its exact remainder. */
+    [[gnu::always_inline, gnu::target("sse2")]] inline __m128i quantiseIntegerCoefficientsSSE2(float const* coefficients, float const* divisors, float const* reciprocals){
+        __m128 const divisor = _mm_loadu_ps(divisors);
+        __m128 const numerator = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(coefficients), _mm_loadu_ps(coefficients)), divisor);
+        __m128 const denominator = _mm_add_ps(divisor, divisor);
+        __m128 quotient = floorSSE2(_mm_mul_ps(numerator, _mm_mul_ps(_mm_loadu_ps(reciprocals), _mm_set1_ps(0.5f))));
+        __m128 const remainder = _mm_sub_ps(numerator, _mm_mul_ps(quotient, denominator));
+        quotient = _mm_sub_ps(quotient, _mm_and_ps(_mm_cmplt_ps(remainder, _mm_setzero_ps()), _mm_set1_ps(1.0f)));
+        quotient = _mm_add_ps(quotient, _mm_and_ps(_mm_cmpge_ps(remainder, denominator), _mm_set1_ps(1.0f)));
+        return _mm_cvttps_epi32(quotient);
+    }
+
+    [[gnu::always_inline, gnu::target("avx2")]] inline __m256 absAVX2(__m256 x){
+        return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x);
+    }
+
+    [[gnu::always_inline, gnu::target("avx2")]] inline bool isNearRoundingBoundaryAVX2(__m256 quotient){
+        __m256 const distance = absAVX2(_mm256_sub_ps(_mm256_sub_ps(quotient, _mm256_floor_ps(quotient)), _mm256_set1_ps(0.5f)));
+        __m256 const tolerance = _mm256_mul_ps(absAVX2(quotient), _mm256_set1_ps(reciprocalTolerance));
+        return _mm256_movemask_ps(_mm256_cmp_ps(distance, tolerance, _CMP_LE_OQ)) != 0;
+    }
+
+    [[gnu::always_inline, gnu::target("avx2")]] inline __m256i roundHalfUpAVX2(__m256 x){
+        __m256 const floored = _mm256_floor_ps(x);
+        __m256 const roundUp = _mm256_and_ps(_mm256_cmp_ps(_mm256_sub_ps(x, floored), _mm256_set1_ps(0.5f), _CMP_GE_OQ), _mm256_set1_ps(1.0f));
+        return _mm256_cvttps_epi32(_mm256_add_ps(floored, roundUp));
+    }
+
+    [[gnu::always_inline, gnu::target("avx2")]] inline __m256i quantiseAVX2(float const* coefficients, float const* divisors, float const* reciprocals){
+        __m256 const coefficient = _mm256_loadu_ps(coefficients);
+        __m256 quotient = _mm256_mul_ps(coefficient, _mm256_loadu_ps(reciprocals));
+        if (isNearRoundingBoundaryAVX2(quotient)){
+            quotient = _mm256_div_ps(coefficient, _mm256_loadu_ps(divisors));
+        }
+        return roundHalfUpAVX2(quotient);
+    }
+
+    [[gnu::always_inline, gnu::target("avx2")]] inline __m256i quantiseIntegerCoefficientsAVX2(float const* coefficients, float const* divisors, float const* reciprocals){
+        __m256 const divisor = _mm256_loadu_ps(divisors);
+        __m256 const numerator = _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(coefficients), _mm256_loadu_ps(coefficients)), divisor);
+        __m256 const denominator = _mm256_add_ps(divisor, divisor);
+        __m256 quotient = _mm256_floor_ps(_mm256_mul_ps(numerator, _mm256_mul_ps(_mm256_loadu_ps(reciprocals), _mm256_set1_ps(0.5f))));
+        __m256 const remainder = _mm256_sub_ps(numerator, _mm256_mul_ps(quotient, denominator));
+        quotient = _mm256_sub_ps(quotient, _mm256_and_ps(_mm256_cmp_ps(remainder, _mm256_setzero_ps(), _CMP_LT_OQ), _mm256_set1_ps(1.0f)));
+        quotient = _mm256_add_ps(quotient, _mm256_and_ps(_mm256_cmp_ps(remainder, denominator, _CMP_GE_OQ), _mm256_set1_ps(1.0f)));
+        return _mm256_cvttps_epi32(quotient);
+    }
+
+    /* Saturates 8 32-bit quotients to 16 bits */
+    [[gnu::always_inline, gnu::target("avx2")]] inline void storeAVX2(__m256i quotients, int16_t* output){
+        __m128i const packed = _mm_packs_epi32(_mm256_castsi256_si128(quotients), _mm256_extracti128_si256(quotients, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output), packed);
+    }
+}
+
+[[gnu::target("sse2")]] void jpeg::Quantiser::quantiseSSE2(float const* coefficients, float const* divisors, float const* reciprocals, int16_t* output){
+    for (size_t i = 0 ; i < BlockGrid::blockElements ; i += 8){
+        __m128i const low = ::quantiseSSE2(coefficients + i, divisors + i, reciprocals + i);
+        __m128i const high = ::quantiseSSE2(coefficients + i + 4, divisors + i + 4, reciprocals + i + 4);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_packs_epi32(low, high));
+    }
+}
+
+[[gnu::target("sse2")]] void jpeg::Quantiser::quantiseIntegerCoefficientsSSE2(float const* coefficients, float const* divisors, float const* reciprocals, int16_t* output){
+    for (size_t i = 0 ; i < BlockGrid::blockElements ; i += 8){
+        __m128i const low = ::quantiseIntegerCoefficientsSSE2(coefficients + i, divisors + i, reciprocals + i);
+        __m128i const high = ::quantiseIntegerCoefficientsSSE2(coefficients + i + 4, divisors + i + 4, reciprocals + i + 4);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_packs_epi32(low, high));
+    }
+}
+
+[[gnu::target("sse2")]] void jpeg::Quantiser::dequantiseSSE2(int16_t const* input, float const* multipliers, float* output){
+    for (size_t i = 0 ; i < BlockGrid::blockElements ; i += 8){
+        // Sign-extend 8 coefficients to 32 bits
+        __m128i const coefficients = _mm_loadu_si128(reinterpret_cast<__m128i const*>(input + i));
+        __m128 const low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(coefficients, coefficients), 16));
+        __m128 const high = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(coefficients, coefficients), 16));
+        _mm_storeu_ps(output + i, _mm_mul_ps(low, _mm_loadu_ps(multipliers + i)));
+        _mm_storeu_ps(output + i + 4, _mm_mul_ps(high, _mm_loadu_ps(multipliers + i + 4)));
+    }
+}
+
+[[gnu::target("avx2")]] void jpeg::Quantiser::quantiseAVX2(float const* coefficients, float const* divisors, float const* reciprocals, int16_t* output){
+    for (size_t i = 0 ; i < BlockGrid::blockElements ; i += 8){
+        storeAVX2(::quantiseAVX2(coefficients + i, divisors + i, reciprocals + i), output + i);
+    }
+}
+
+[[gnu::target("avx2")]] void jpeg::Quantiser::quantiseIntegerCoefficientsAVX2(float const* coefficients, float const* divisors, float const* reciprocals, int16_t* output){
+    for (size_t i = 0 ; i < BlockGrid::blockElements ; i += 8){
+        storeAVX2(::quantiseIntegerCoefficientsAVX2(coefficients + i, divisors + i, reciprocals + i), output + i);
+    }
+}
+
+[[gnu::target("avx2")]] void jpeg::Quantiser::dequantiseAVX2(int16_t const* input, float const* multipliers, float* output){
+    for (size_t i = 0 ; i < BlockGrid::blockElements ; i += 8){
+        __m256i const coefficients = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const*>(input + i)));
+        _mm256_storeu_ps(output + i, _mm256_mul_ps(_mm256_cvtepi32_ps(coefficients), _mm256_loadu_ps(multipliers + i)));
+    }
+}
+
+#endif
@@ -0,0 +1,42 @@
+#include "simd.hpp"
+
+/* The most capable instruction set supported by both the CPU and the OS (as reported by CPUID) */
+jpeg::SimdLevel jpeg::getSupportedSimdLevel(){
+#if JPEG_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")){
+        return SimdLevel::AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")){
+        return SimdLevel::SSE2;
+    }
+#endif
+    return SimdLevel::Scalar;
+}
+
+/* The supported instruction set, unless limited by the JPEG_SIMD environment variable (one of 'scalar', 'sse2' or 
+   'avx2'), which allows each kernel to be forced for testing */
+jpeg::SimdLevel jpeg::getPreferredSimdLevel(){
+    SimdLevel const supportedLevel = getSupportedSimdLevel();
+    char const* const override = std::getenv("JPEG_SIMD");
+    if (override){
+        for (SimdLevel simdLevel : {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2}){
+            if (std::strcmp(override, getSimdLevelName(simdLevel)) == 0){
+                return std::min(simdLevel, supportedLevel);
+            }
+        }
+    }
+    return supportedLevel;
+}
+
+char const* jpeg::getSimdLevelName(SimdLevel simdLevel){
+    switch (simdLevel){
+        case SimdLevel::AVX2:
+            return "avx2";
+        case SimdLevel::SSE2:
+            return "sse2";
+        case SimdLevel::Scalar:
+        default:
+            return "scalar";
+    }
+}
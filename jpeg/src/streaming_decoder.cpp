@@ -0,0 +1,61 @@
+#include "streaming_decoder.hpp"
+
+jpeg::StreamingDecoder::StreamingDecoder(Encoder const& encoder, OutputSink sink) : m_encoder{encoder}, m_sink{std::move(sink)}{
+}
+
+void jpeg::StreamingDecoder::decode(JPEGImage const& inputImage){
+    try{
+        BitStream const& inputStream = inputImage.m_compressedImageData;
+        BitStreamReadProgress readProgress{};
+        BitmapImageRGB imageDimensions;
+        uint16_t restartInterval = 0;
+        std::shared_ptr<DecodingTables const> const tables = m_encoder.decodeHeader(inputStream, readProgress, imageDimensions, restartInterval);
+        if (tables->m_arithmeticEncoder){
+            // The arithmetic decoder reads ahead of the blocks it has decoded, so the markers cannot be found in turn
+            throw std::runtime_error("Streaming decoding of arithmetic-coded JPEGs is not supported");
+        }
+        BitReader inputReader(inputStream.getBytes(), readProgress.currentByte);
+
+        uint16_t const width = imageDimensions.m_width;
+        uint16_t const height = imageDimensions.height;
+        std::array<int16_t, 3> lastDCValues = {0,0,0};
+        size_t decodedBlocks = 0;
+        for (uint16_t firstRow = 0 ; firstRow < height ; firstRow += BlockGrid::blockSize){
+            OutputBlockGrid band(width, std::min<uint16_t>(BlockGrid::blockSize, height - firstRow));
+            for (size_t block = 0 ; block < band.getNumBlocks() ; ++block){
+                if (restartInterval > 0 && decodedBlocks > 0 && decodedBlocks % restartInterval == 0){
+                    // Restart markers are byte-aligned, and reset the DC predictors
+                    uint16_t const expectedMarker = markerRestartIntervalRST0 + (decodedBlocks / restartInterval - 1) % 8;
+                    if (readAlignedMarker(inputStream, inputReader) != expectedMarker){
+                        throw std::runtime_error("Failed to find expected RST marker");
+                    }
+                    lastDCValues = {0,0,0};
+                }
+                band.processBlock(block, m_encoder.decodeBlock(inputReader, lastDCValues, *tables));
+                ++decodedBlocks;
+            }
+            m_sink(firstRow, band.getBitmapRGB());
+        }
+
+        // Check end of image marker
+        if (readAlignedMarker(inputStream, inputReader) != markerEndOfImageSegmentEOI){
+            throw std::runtime_error("Failed to find EOI marker");
+        }
+    }
+    catch(std::exception const& e){
+        std::cout << "[Error]: " << e.what() << "\n";
+    }
+}
+
+/* Reads the marker following the current entropy-coded segment (skipping any fill bytes before it), then continues
+   reading the segment after it */
+uint16_t jpeg::StreamingDecoder::readAlignedMarker(BitStream const& inputStream, BitReader& inputReader) const{
+    BitStreamReadProgress readProgress{};
+    readProgress.currentByte = inputStream.skipFillBytes(inputReader.getAlignedPosition());
+    if (readProgress.currentByte + 2 > inputStream.getSize()){
+        throw std::runtime_error("Unexpected end of JPEG data");
+    }
+    uint16_t const marker = inputStream.readNextAlignedWord(readProgress);
+    inputReader = BitReader(inputStream.getBytes(), readProgress.currentByte);
+    return marker;
+}
@@ -0,0 +1,62 @@
+#include "streaming_encoder.hpp"
+
+jpeg::StreamingEncoder::StreamingEncoder(Encoder const& encoder, uint16_t width, uint16_t height, OutputSink& sink) : 
+    m_encoder{encoder}, m_width{width}, m_height{height}, m_rowsEncoded{0}, m_band{width, BlockGrid::blockSize}, m_rowsInBand{0},
+    m_lastDCValues{0,0,0}, m_sink{sink}{
+    m_encoder.encodeHeader(m_width, m_height, m_outputStream, *m_encoder.m_quantiser, *m_encoder.m_entropyEncoder, 0);
+    m_outputStream.flushCompleteBytes(m_sink);
+    m_outputStream.setByteStuffing(true);
+    if (isComplete()){
+        m_sink.flush();
+    }
+}
+
+/* Accepts any whole number of rows of pixels, encoding each band of rows once it is complete */
+void jpeg::StreamingEncoder::pushRows(std::span<BitmapImageRGB::PixelData const> rows){
+    try{
+        if (rows.size() % m_width != 0){
+            throw std::runtime_error("Streamed pixel data must consist of whole rows");
+        }
+        if (m_rowsEncoded + m_rowsInBand + rows.size() / m_width > m_height){
+            throw std::runtime_error("Streamed pixel data exceeds image height");
+        }
+        while (!rows.empty()){
+            // Last band may be shorter than a block
+            uint16_t const bandHeight = std::min<uint16_t>(BlockGrid::blockSize, m_height - m_rowsEncoded);
+            size_t const rowsToCopy = std::min<size_t>(bandHeight - m_rowsInBand, rows.size() / m_width);
+            std::copy(rows.begin(), rows.begin() + rowsToCopy * m_width, m_band.m_imageData.begin() + m_rowsInBand * m_width);
+            rows = rows.subspan(rowsToCopy * m_width);
+            m_rowsInBand += rowsToCopy;
+            if (m_rowsInBand == bandHeight){
+                m_band.height = bandHeight;
+                m_band.m_imageData.resize(size_t(m_width) * bandHeight);
+                encodeBand();
+            }
+        }
+    }
+    catch(std::exception const& e){
+        std::cout << "[Error]: " << e.what() << "\n";
+    }
+}
+
+bool jpeg::StreamingEncoder::isComplete() const{
+    return m_rowsEncoded == m_height;
+}
+
+void jpeg::StreamingEncoder::encodeBand(){
+    InputBlockGrid blockGrid(m_band);
+    m_encoder.encodeBlocks(blockGrid.begin(), blockGrid.end(), m_lastDCValues, m_outputStream);
+    m_rowsEncoded += m_rowsInBand;
+    m_rowsInBand = 0;
+    if (isComplete()){
+        m_outputStream.pushIntoAlignment();
+        m_outputStream.setByteStuffing(false);
+        // Push end of image marker
+        m_outputStream.pushWord(markerEndOfImageSegmentEOI);
+    }
+    // Only complete bytes are flushed - the partially filled byte is carried into the next band
+    m_outputStream.flushCompleteBytes(m_sink);
+    if (isComplete()){
+        m_sink.flush();
+    }
+}
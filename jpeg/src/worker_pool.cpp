@@ -0,0 +1,95 @@
+#include "worker_pool.hpp"
+
+jpeg::WorkerPool::WorkerPool(unsigned int numWorkers) : m_task{nullptr}, m_numTasks{0}, m_nextTask{0}, m_busyWorkers{0},
+                                                        m_generation{0}, m_stopping{false}{
+    for (size_t workerIndex = 1 ; workerIndex < numWorkers ; ++workerIndex){
+        m_threads.emplace_back(&WorkerPool::workerLoop, this, workerIndex);
+    }
+}
+
+jpeg::WorkerPool::~WorkerPool(){
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+    }
+    m_workAvailable.notify_all();
+    for (auto& thread : m_threads){
+        thread.join();
+    }
+}
+
+size_t jpeg::WorkerPool::getNumWorkers() const{
+    return m_threads.size() + 1;
+}
+
+void jpeg::WorkerPool::run(size_t numTasks, Task const& task){
+    if (numTasks == 0){
+        return;
+    }
+    {
+        std::lock_guard lock(m_mutex);
+        m_task = &task;
+        m_numTasks = numTasks;
+        m_nextTask = 0;
+        m_busyWorkers = m_threads.size();
+        m_exception = nullptr;
+        ++m_generation;
+    }
+    m_workAvailable.notify_all();
+    // Calling thread acts as worker 0
+    processTasks(0);
+    std::exception_ptr exception;
+    {
+        std::unique_lock lock(m_mutex);
+        m_workComplete.wait(lock, [this]{return m_busyWorkers == 0;});
+        m_task = nullptr;
+        exception = m_exception;
+    }
+    if (exception){
+        std::rethrow_exception(exception);
+    }
+}
+
+void jpeg::WorkerPool::workerLoop(size_t workerIndex){
+    size_t lastGeneration = 0;
+    while (true){
+        {
+            std::unique_lock lock(m_mutex);
+            m_workAvailable.wait(lock, [&]{return m_stopping || m_generation != lastGeneration;});
+            if (m_stopping){
+                return;
+            }
+            lastGeneration = m_generation;
+        }
+        processTasks(workerIndex);
+        {
+            std::lock_guard lock(m_mutex);
+            if (--m_busyWorkers == 0){
+                m_workComplete.notify_one();
+            }
+        }
+    }
+}
+
+void jpeg::WorkerPool::processTasks(size_t workerIndex){
+    while (true){
+        size_t taskIndex;
+        {
+            std::lock_guard lock(m_mutex);
+            if (m_nextTask >= m_numTasks){
+                return;
+            }
+            taskIndex = m_nextTask++;
+        }
+        try{
+            (*m_task)(taskIndex, workerIndex);
+        }
+        catch(...){
+            // Only the first exception is propagated to the caller of run()
+            std::lock_guard lock(m_mutex);
+            if (!m_exception){
+                m_exception = std::current_exception();
+            }
+        }
+    }
+}